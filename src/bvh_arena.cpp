@@ -0,0 +1,125 @@
+#include "bvh_arena.h"
+
+#include <cstdint>
+#include <cstdlib>
+
+#include <sys/mman.h>
+
+// Allocations larger than this part of a block get a block of their own
+static const size_t dedicated_block_fraction = 4;
+
+Arena::Arena(size_t block_bytes)
+{
+    head = NULL;
+    cursor = NULL;
+    limit = NULL;
+    block_size = block_bytes;
+    allocated_bytes = 0;
+    num_blocks = 0;
+}
+
+Arena::~Arena()
+{
+    reset();
+}
+
+Arena::BLOCK * Arena::new_block(size_t bytes)
+{
+    BLOCK * block = static_cast<BLOCK *>(malloc(sizeof(BLOCK) + bytes));
+    if (!block)
+        throw std::bad_alloc();
+
+    num_blocks++;
+    return block;
+}
+
+void * Arena::allocate(size_t bytes, size_t alignment)
+{
+    uintptr_t address = reinterpret_cast<uintptr_t>(cursor);
+    size_t padding = (alignment - address % alignment) % alignment;
+
+    if (!head || padding + bytes > (size_t) (limit - cursor)) {
+        if (bytes > block_size / dedicated_block_fraction) {
+            // linked behind head so the current block keeps serving small allocations
+            BLOCK * block = new_block(bytes + alignment - 1);
+
+            if (head) {
+                block->next = head->next;
+                head->next = block;
+            }
+            else {
+                block->next = NULL;
+                head = block;
+                cursor = limit = reinterpret_cast<char *>(block + 1);
+            }
+
+            char * memory = reinterpret_cast<char *>(block + 1);
+            address = reinterpret_cast<uintptr_t>(memory);
+            allocated_bytes += bytes;
+            return memory + (alignment - address % alignment) % alignment;
+        }
+
+        BLOCK * block = new_block(block_size);
+        block->next = head;
+        head = block;
+        cursor = reinterpret_cast<char *>(block + 1);
+        limit = cursor + block_size;
+
+        address = reinterpret_cast<uintptr_t>(cursor);
+        padding = (alignment - address % alignment) % alignment;
+    }
+
+    char * memory = cursor + padding;
+    cursor = memory + bytes;
+    allocated_bytes += bytes;
+    return memory;
+}
+
+void Arena::reset()
+{
+    while (head) {
+        BLOCK * next = head->next;
+        free(head);
+        head = next;
+    }
+
+    cursor = NULL;
+    limit = NULL;
+    allocated_bytes = 0;
+    num_blocks = 0;
+}
+
+ReservedBuffer::ReservedBuffer()
+{
+    base = NULL;
+    length = 0;
+}
+
+ReservedBuffer::~ReservedBuffer()
+{
+    release();
+}
+
+bool ReservedBuffer::reserve(size_t bytes)
+{
+    release();
+
+    // untouched pages of an anonymous mapping take no memory, and without
+    // the swap reservation the size is only bounded by the address space
+    void * address = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (address == MAP_FAILED)
+        return false;
+
+    base = static_cast<char *>(address);
+    length = bytes;
+    return true;
+}
+
+void ReservedBuffer::release()
+{
+    if (base)
+        munmap(base, length);
+
+    base = NULL;
+    length = 0;
+}
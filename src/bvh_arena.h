@@ -0,0 +1,131 @@
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <vector>
+
+// Monotonic allocator: allocations are carved out of a few large blocks and
+// are never freed one by one, every block is released at once by reset() or
+// the destructor
+class Arena
+{
+    public:
+        // Size of the blocks small allocations share
+        static const size_t default_block_bytes = 64 << 10;
+
+        explicit Arena(size_t block_bytes = default_block_bytes);
+        ~Arena();
+
+        // Returns uninitialized memory aligned to "alignment" (a power of two)
+        void * allocate(size_t bytes, size_t alignment = 16);
+
+        template <typename T>
+        T * allocate_array(size_t count) {
+            return static_cast<T *>(allocate(count * sizeof(T), alignof(T) > 16 ? alignof(T) : 16));
+        }
+
+        // Releases every block, whatever was allocated is gone
+        void reset();
+
+        // Bytes handed out and blocks taken from the system
+        size_t bytes() const { return allocated_bytes; }
+        size_t blocks() const { return num_blocks; }
+
+    private:
+        Arena(const Arena &);
+        Arena & operator=(const Arena &);
+
+        // Header of every block, the usable memory follows it
+        struct BLOCK
+        {
+            BLOCK * next;
+        };
+
+        BLOCK * head;           // block being carved, then older and dedicated ones
+        char * cursor;          // next free byte in head
+        char * limit;           // end of head
+        size_t block_size;
+        size_t allocated_bytes;
+        size_t num_blocks;
+
+        BLOCK * new_block(size_t bytes);
+};
+
+// Address space reserved up front that is only backed by memory as it is
+// written, so a buffer grows in place: pointers into it stay valid while it
+// fills, for readers on other threads too
+class ReservedBuffer
+{
+    public:
+        ReservedBuffer();
+        ~ReservedBuffer();
+
+        // Reserves "bytes" of address space, false if there is not enough
+        bool reserve(size_t bytes);
+        void release();
+
+        char * data() const { return base; }
+        size_t capacity() const { return length; }
+
+    private:
+        ReservedBuffer(const ReservedBuffer &);
+        ReservedBuffer & operator=(const ReservedBuffer &);
+
+        char * base;
+        size_t length;
+};
+
+// Standard allocator over an arena, deallocate() does nothing
+template <typename T>
+struct ArenaAllocator
+{
+    typedef T value_type;
+
+    Arena * arena;
+
+    explicit ArenaAllocator(Arena & owner) { arena = &owner; }
+
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U> & other) { arena = other.arena; }
+
+    T * allocate(size_t count) { return arena->allocate_array<T>(count); }
+    void deallocate(T *, size_t) {}
+
+    template <typename U>
+    bool operator==(const ArenaAllocator<U> & other) const { return arena == other.arena; }
+    template <typename U>
+    bool operator!=(const ArenaAllocator<U> & other) const { return arena != other.arena; }
+};
+
+// Growable array in an arena, the space of outgrown storage is only
+// reclaimed with the arena
+template <typename T>
+using ARENA_VECTOR = std::vector<T, ArenaAllocator<T> >;
+
+// Fixed size array in an arena
+template <typename T>
+struct ARENA_ARRAY
+{
+    T * data;
+    size_t count;
+
+    ARENA_ARRAY() {
+        data = NULL;
+        count = 0;
+    }
+
+    // Allocates "elements" default constructed elements
+    void allocate(Arena & arena, size_t elements) {
+        data = arena.allocate_array<T>(elements);
+        count = elements;
+
+        for (size_t i = 0; i < count; i++)
+            new (data + i) T();
+    }
+
+    T & operator[](size_t i) const { return data[i]; }
+    T * begin() const { return data; }
+    T * end() const { return data + count; }
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+};
@@ -0,0 +1,315 @@
+#include "bvh_loader.h"
+#include "bvh_cache.h"
+
+static inline uint64_t rotate_left(uint64_t x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t mix(uint64_t h)
+{
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+uint64_t hash_bytes(const void * data, size_t length, uint64_t seed)
+{
+    static const uint64_t prime1 = 0x9e3779b185ebca87ULL;
+    static const uint64_t prime2 = 0xc2b2ae3d27d4eb4fULL;
+
+    const unsigned char * p = static_cast<const unsigned char *>(data);
+    const unsigned char * end = p + length;
+
+    // four independent lanes so the multiplies overlap
+    uint64_t lane[4] = { seed + prime1, seed + prime2, seed, seed - prime1 };
+
+    while (end - p >= 32) {
+        for (int i = 0; i < 4; i++) {
+            uint64_t word;
+            memcpy(&word, p + i * 8, 8);
+            lane[i] = rotate_left(lane[i] + word * prime2, 31) * prime1;
+        }
+        p += 32;
+    }
+
+    uint64_t h = rotate_left(lane[0], 1) + rotate_left(lane[1], 7) +
+                 rotate_left(lane[2], 12) + rotate_left(lane[3], 18);
+    h += length;
+
+    while (end - p >= 8) {
+        uint64_t word;
+        memcpy(&word, p, 8);
+        h = rotate_left(h ^ (word * prime2), 27) * prime1;
+        p += 8;
+    }
+
+    while (p < end)
+        h = rotate_left(h ^ (*p++ * prime1), 11) * prime2;
+
+    return mix(h);
+}
+
+std::string cache_filename(const char * filename)
+{
+    std::string name(filename);
+    size_t length = name.size();
+
+    if (length >= 4 && name.compare(length - 4, 4, ".bvh") == 0)
+        return name + "b";
+
+    return name + ".bvhb";
+}
+
+std::string index_filename(const char * filename)
+{
+    std::string name(filename);
+    size_t length = name.size();
+
+    if (length >= 4 && name.compare(length - 4, 4, ".bvh") == 0)
+        return name + "i";
+
+    return name + ".bvhi";
+}
+
+// Appends the raw bytes of value to the buffer
+template <typename T>
+static void put(string & buffer, const T & value)
+{
+    buffer.append(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+// Reads a T from the cursor, false if it would read past end
+template <typename T>
+static bool get(const char * & cursor, const char * end, T & value)
+{
+    if (end - cursor < (ptrdiff_t) sizeof(T))
+        return false;
+
+    memcpy(&value, cursor, sizeof(T));
+    cursor += sizeof(T);
+    return true;
+}
+
+void BVH::save_cache(const string & cache_name, uint64_t source_hash, uint64_t source_size, int64_t source_mtime)
+{
+    string hierarchy;
+
+    // the skeleton is already in depth first order
+    for (unsigned int joint = 0; joint < skeleton.num_joints; joint++) {
+        unsigned int num_channels = skeleton.num_channels[joint];
+        unsigned int channel_start = skeleton.channel_start[joint];
+
+        put(hierarchy, (int32_t) skeleton.parent[joint]);
+        put(hierarchy, (uint32_t) num_channels);
+        put(hierarchy, (uint32_t) channel_start);
+        put(hierarchy, skeleton.offset[joint].x);
+        put(hierarchy, skeleton.offset[joint].y);
+        put(hierarchy, skeleton.offset[joint].z);
+        put(hierarchy, (uint32_t) strlen(skeleton.name[joint]));
+
+        for (unsigned int i = 0; i < num_channels; i++)
+            put(hierarchy, (int16_t) skeleton.channels_order[channel_start + i]);
+
+        hierarchy.append(skeleton.name[joint]);
+    }
+
+    BVHB_HEADER header;
+    memset(&header, 0, sizeof(header));
+
+    header.magic = BVHB_MAGIC;
+    header.version = BVHB_VERSION;
+    header.source_hash = source_hash;
+    header.source_size = source_size;
+    header.source_mtime = source_mtime;
+    header.num_joints = skeleton.num_joints;
+    header.num_motion_channels = motionData.num_motion_channels;
+    header.num_frames = motionData.num_frames;
+    header.frame_time = motionData.frame_time;
+    header.hierarchy_offset = sizeof(BVHB_HEADER);
+    header.hierarchy_size = hierarchy.size();
+
+    // motion block starts aligned for SIMD loads once mapped
+    uint64_t hierarchy_end = header.hierarchy_offset + header.hierarchy_size;
+    header.motion_offset = (hierarchy_end + BVHB_ALIGNMENT - 1) / BVHB_ALIGNMENT * BVHB_ALIGNMENT;
+    header.motion_size = (uint64_t) motionData.num_frames * motionData.num_motion_channels * sizeof(float);
+
+    uint64_t checksum = hash_bytes(&header, sizeof(header));
+    checksum = hash_bytes(hierarchy.data(), hierarchy.size(), checksum);
+    header.hierarchy_checksum = checksum;
+    header.checksum = hash_bytes(motionData.data, header.motion_size, checksum);
+
+    string padding(header.motion_offset - hierarchy_end, '\0');
+
+    // a reader never maps a partial file
+    AtomicFile outfile;
+
+    if (!outfile.open(cache_name.c_str()))
+        return;
+
+    outfile.write(&header, sizeof(header));
+    outfile.write(hierarchy.data(), hierarchy.size());
+    outfile.write(padding.data(), padding.size());
+    outfile.write(motionData.data, header.motion_size);
+    outfile.commit();
+}
+
+bool BVH::load_cache(const string & cache_name, const uint64_t * source_hash, uint64_t source_size, int64_t source_mtime)
+{
+    if (!cacheFile.open(cache_name.c_str()))
+        return false;
+
+    const char * begin = cacheFile.begin();
+    const char * end = cacheFile.end();
+
+    BVHB_HEADER header;
+    const char * cursor = begin;
+
+    if (!get(cursor, end, header) ||
+        header.magic != BVHB_MAGIC || header.version != BVHB_VERSION ||
+        (source_hash ? header.source_hash != *source_hash : header.source_mtime != source_mtime) ||
+        header.source_size != source_size ||
+        header.num_joints == 0 ||
+        header.hierarchy_offset != sizeof(BVHB_HEADER) ||
+        header.motion_offset % BVHB_ALIGNMENT != 0 ||
+        header.motion_offset < header.hierarchy_offset + header.hierarchy_size ||
+        header.motion_size != (uint64_t) header.num_frames * header.num_motion_channels * sizeof(float) ||
+        header.motion_offset + header.motion_size > cacheFile.size()) {
+        cacheFile.close();
+        return false;
+    }
+
+    BVHB_HEADER zeroed = header;
+    zeroed.checksum = 0;
+    zeroed.hierarchy_checksum = 0;
+
+    // the motion block is only read through with a source hash to check
+    uint64_t checksum = hash_bytes(&zeroed, sizeof(zeroed));
+    checksum = hash_bytes(begin + header.hierarchy_offset, header.hierarchy_size, checksum);
+    bool intact = checksum == header.hierarchy_checksum;
+
+    if (intact && source_hash)
+        intact = hash_bytes(begin + header.motion_offset, header.motion_size, checksum) == header.checksum;
+
+    if (!intact) {
+        cacheFile.close();
+        return false;
+    }
+
+    // the depth first records fill the skeleton in order
+    cursor = begin + header.hierarchy_offset;
+    const char * hierarchy_end = cursor + header.hierarchy_size;
+    bool valid = true;
+
+    skeleton.channels_order.resize(header.num_motion_channels);
+
+    for (uint32_t i = 0; i < header.num_joints && valid; i++) {
+        int32_t parent_index;
+        uint32_t num_channels, channel_start, name_length;
+        glm::vec3 offset;
+
+        valid = get(cursor, hierarchy_end, parent_index) &&
+                get(cursor, hierarchy_end, num_channels) &&
+                get(cursor, hierarchy_end, channel_start) &&
+                get(cursor, hierarchy_end, offset.x) &&
+                get(cursor, hierarchy_end, offset.y) &&
+                get(cursor, hierarchy_end, offset.z) &&
+                get(cursor, hierarchy_end, name_length) &&
+                parent_index < (int32_t) i && (parent_index >= 0 || i == 0) &&
+                channel_start <= header.num_motion_channels &&
+                num_channels <= header.num_motion_channels - channel_start;
+
+        for (uint32_t c = 0; c < num_channels && valid; c++) {
+            int16_t channel;
+            valid = get(cursor, hierarchy_end, channel);
+            skeleton.channels_order[channel_start + c] = channel;
+        }
+
+        valid = valid && (uint64_t) (hierarchy_end - cursor) >= name_length;
+
+        if (!valid)
+            break;
+
+        unsigned int joint = skeleton.add_joint(parent_index, cursor, name_length);
+        cursor += name_length;
+
+        skeleton.offset[joint] = offset;
+        skeleton.num_channels[joint] = num_channels;
+        skeleton.channel_start[joint] = channel_start;
+    }
+
+    if (!valid) {
+        skeleton.clear();
+        cacheFile.close();
+        return false;
+    }
+
+    motionData.num_frames = header.num_frames;
+    motionData.num_motion_channels = header.num_motion_channels;
+    motionData.frame_time = header.frame_time;
+
+    // the sidecar holds every channel of the frame lines
+    line_channels = header.num_motion_channels;
+
+    // the motion block is used in place, the mapping lives as long as this object
+    motionData.data = reinterpret_cast<float *>(const_cast<char *>(begin + header.motion_offset));
+
+    return true;
+}
+
+void BVH::save_index(const string & index_name, uint64_t source_size, int64_t source_mtime)
+{
+    BVHI_HEADER header;
+    memset(&header, 0, sizeof(header));
+
+    header.magic = BVHI_MAGIC;
+    header.version = BVHI_VERSION;
+    header.source_size = source_size;
+    header.source_mtime = source_mtime;
+    header.num_frames = text_frames;
+
+    AtomicFile outfile;
+
+    if (!outfile.open(index_name.c_str()))
+        return;
+
+    outfile.write(&header, sizeof(header));
+    outfile.write(frame_offsets, (size_t) text_frames * sizeof(uint64_t));
+    outfile.commit();
+}
+
+bool BVH::load_index(const string & index_name, uint64_t source_size, int64_t source_mtime)
+{
+    if (!indexFile.open(index_name.c_str()))
+        return false;
+
+    const char * cursor = indexFile.begin();
+    BVHI_HEADER header;
+
+    if (!get(cursor, indexFile.end(), header) ||
+        header.magic != BVHI_MAGIC || header.version != BVHI_VERSION ||
+        header.source_size != source_size || header.source_mtime != source_mtime ||
+        header.num_frames != text_frames ||
+        indexFile.size() != sizeof(BVHI_HEADER) + (uint64_t) header.num_frames * sizeof(uint64_t)) {
+        indexFile.close();
+        return false;
+    }
+
+    // the offsets are used in place, so they must stay within the frame lines
+    const uint64_t * offsets = reinterpret_cast<const uint64_t *>(cursor);
+    uint64_t previous = motion_lines - sourceFile.begin();
+
+    for (uint32_t frame = 0; frame < header.num_frames; frame++) {
+        if (offsets[frame] < previous || offsets[frame] >= source_size) {
+            indexFile.close();
+            return false;
+        }
+        previous = offsets[frame] + 1;
+    }
+
+    frame_offsets = offsets;
+    return true;
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstddef>
+#include <stdint.h>
+#include <string>
+
+// Binary sidecar (.bvhb) written next to a text BVH file.
+//
+// Layout, all values in native byte order:
+//   BVHB_HEADER
+//   hierarchy: one record per joint in depth first order
+//       int32 parent index (-1 for the root), uint32 num_channels,
+//       uint32 channel_start, float offset[3], uint32 name length,
+//       int16 channels_order[num_channels], name characters
+//   padding up to motion_offset (a multiple of BVHB_ALIGNMENT)
+//   motion: num_frames * num_motion_channels floats, frame after frame
+//
+// The hierarchy checksum covers the header (with both checksum fields
+// zeroed) and the hierarchy, the checksum carries on from it over the motion
+// block. source_hash/source_size identify the text file the sidecar was made
+// from; a sidecar whose source no longer matches is ignored and rewritten.
+// A progressive load only compares source_size and source_mtime and checks
+// the hierarchy, so it does not read all of both files before the first frame.
+
+static const uint32_t BVHB_MAGIC = 0x42485642;     // "BVHB"
+static const uint32_t BVHB_VERSION = 3;
+static const uint64_t BVHB_ALIGNMENT = 64;
+
+struct BVHB_HEADER
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t checksum;
+    uint64_t hierarchy_checksum;
+    uint64_t source_hash;
+    uint64_t source_size;
+    int64_t source_mtime;       // nanoseconds since the epoch
+    uint32_t num_joints;
+    uint32_t num_motion_channels;
+    uint32_t num_frames;
+    float frame_time;
+    uint64_t hierarchy_offset;
+    uint64_t hierarchy_size;
+    uint64_t motion_offset;
+    uint64_t motion_size;
+};
+
+// Frame index sidecar (.bvhi) of a text BVH file, for parsing frames on demand.
+//
+// Layout, all values in native byte order:
+//   BVHI_HEADER
+//   uint64 offsets[num_frames]: byte offset in the text of every frame line
+//
+// The index is only used while the text file still has source_size and
+// source_mtime, it is rebuilt otherwise.
+
+static const uint32_t BVHI_MAGIC = 0x49485642;     // "BVHI"
+static const uint32_t BVHI_VERSION = 1;
+
+struct BVHI_HEADER
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t source_size;
+    int64_t source_mtime;       // nanoseconds since the epoch
+    uint32_t num_frames;
+    uint32_t reserved;
+};
+
+// Fast non-cryptographic 64 bit hash, used for the source hash and checksum
+uint64_t hash_bytes(const void * data, size_t length, uint64_t seed = 0);
+
+// Returns the sidecar name for a BVH file ("walk.bvh" -> "walk.bvhb")
+std::string cache_filename(const char * filename);
+
+// Returns the frame index name for a BVH file ("walk.bvh" -> "walk.bvhi")
+std::string index_filename(const char * filename);
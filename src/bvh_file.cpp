@@ -0,0 +1,140 @@
+#include "bvh_file.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <sstream>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+bool file_stamp(const char * filename, uint64_t & size, int64_t & mtime)
+{
+    struct stat info;
+    if (stat(filename, &info) != 0)
+        return false;
+
+    size = info.st_size;
+#ifdef __APPLE__
+    mtime = (int64_t) info.st_mtimespec.tv_sec * 1000000000 + info.st_mtimespec.tv_nsec;
+#else
+    mtime = (int64_t) info.st_mtim.tv_sec * 1000000000 + info.st_mtim.tv_nsec;
+#endif
+    return true;
+}
+
+FileWatch::FileWatch()
+{
+    seen_size = polled_size = 0;
+    seen_mtime = polled_mtime = 0;
+}
+
+void FileWatch::watch(const char * filename)
+{
+    name = filename;
+
+    if (!file_stamp(filename, seen_size, seen_mtime))
+        seen_size = seen_mtime = 0;
+
+    polled_size = seen_size;
+    polled_mtime = seen_mtime;
+}
+
+bool FileWatch::changed()
+{
+    uint64_t size;
+    int64_t mtime;
+
+    // a file missing for a moment while it is replaced is not a change yet
+    if (name.empty() || !file_stamp(name.c_str(), size, mtime))
+        return false;
+
+    bool settled = size == polled_size && mtime == polled_mtime;
+    polled_size = size;
+    polled_mtime = mtime;
+
+    if (!settled || (size == seen_size && mtime == seen_mtime))
+        return false;
+
+    seen_size = size;
+    seen_mtime = mtime;
+    return true;
+}
+
+AtomicFile::AtomicFile()
+{
+    file = -1;
+    failed = false;
+}
+
+AtomicFile::~AtomicFile()
+{
+    discard();
+}
+
+bool AtomicFile::open(const char * filename)
+{
+    discard();
+
+    // the same file may be written from several threads or processes at once
+    std::ostringstream name;
+    name << filename << ".tmp" << getpid() << "." << this;
+
+    final_name = filename;
+    temp_name = name.str();
+    failed = false;
+
+    file = ::open(temp_name.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    return file >= 0;
+}
+
+bool AtomicFile::write(const void * data, size_t bytes)
+{
+    const char * cursor = static_cast<const char *>(data);
+
+    while (bytes && file >= 0 && !failed) {
+        ssize_t count = ::write(file, cursor, bytes);
+
+        if (count < 0 && errno == EINTR)
+            continue;
+        if (count <= 0)
+            failed = true;
+        else {
+            cursor += count;
+            bytes -= count;
+        }
+    }
+
+    return file >= 0 && !failed;
+}
+
+bool AtomicFile::commit()
+{
+    if (file < 0 || failed) {
+        discard();
+        return false;
+    }
+
+    // the data reaches the disk before the rename does, so a crash cannot
+    // leave the final name on a partly written file
+    bool written = fsync(file) == 0;
+    written = ::close(file) == 0 && written;
+    file = -1;
+
+    if (!written || rename(temp_name.c_str(), final_name.c_str()) != 0) {
+        remove(temp_name.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+void AtomicFile::discard()
+{
+    if (file < 0)
+        return;
+
+    ::close(file);
+    remove(temp_name.c_str());
+    file = -1;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstddef>
+#include <stdint.h>
+#include <string>
+
+using std::size_t;
+using std::string;
+
+// Size and modification time (in nanoseconds) of a file, false if it cannot be stat'ed
+bool file_stamp(const char * filename, uint64_t & size, int64_t & mtime);
+
+// Polls a file for being rewritten or replaced. A change is reported once
+// the file looks the same on two polls in a row, so one still being
+// written is not picked up half done.
+class FileWatch
+{
+    public:
+        FileWatch();
+
+        // Starts watching, the file as it is now counts as seen
+        void watch(const char * filename);
+
+        // Whether the file changed since it was last seen and has settled
+        bool changed();
+
+    private:
+        string name;
+        uint64_t seen_size, polled_size;
+        int64_t seen_mtime, polled_mtime;
+};
+
+// A file written under a temporary name next to the final one, unique to
+// this process and object, and renamed over it by commit() once complete and
+// synced to disk, so a reader finds the old file or all of the new one.
+// A file not committed is removed.
+class AtomicFile
+{
+    public:
+        AtomicFile();
+        ~AtomicFile();
+
+        // Creates the temporary file for "filename"
+        bool open(const char * filename);
+
+        // Appends bytes, resuming after partial writes and interruptions;
+        // after a failure the file can no longer be committed
+        bool write(const void * data, size_t bytes);
+
+        // Syncs, closes and renames the file over the final one, false if
+        // any step or an earlier write failed
+        bool commit();
+
+    private:
+        AtomicFile(const AtomicFile &);
+        AtomicFile & operator=(const AtomicFile &);
+
+        // Closes and removes the temporary file
+        void discard();
+
+        string final_name;
+        string temp_name;
+        int file;
+        bool failed;
+};
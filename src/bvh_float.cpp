@@ -0,0 +1,164 @@
+#include "bvh_float.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+float parse_float_slow(const char * begin, const char * end)
+{
+    char buffer[64];
+    size_t length = end - begin;
+
+    if (length >= sizeof(buffer))
+        length = sizeof(buffer) - 1;
+
+    // tokens are not null terminated, copy to the stack before converting
+    memcpy(buffer, begin, length);
+    buffer[length] = '\0';
+
+    return strtof(buffer, NULL);
+}
+
+// value * 10^exponent in double, exact for the table's powers
+static double scale(double value, int exponent)
+{
+    if (exponent >= 0)
+        return exponent <= 22 ? value * bvh_float::powers_of_ten[exponent] : value * std::pow(10.0, exponent);
+    return -exponent <= 22 ? value / bvh_float::powers_of_ten[-exponent] : value / std::pow(10.0, -exponent);
+}
+
+// Whether mantissa * 10^exponent reads back as value
+static bool round_trips(uint64_t mantissa, int exponent, float value)
+{
+    float parsed;
+
+    if (!bvh_float::decimal_to_float(mantissa, exponent, false, parsed)) {
+        char buffer[32];
+        int length = snprintf(buffer, sizeof(buffer), "%llue%d", (unsigned long long) mantissa, exponent);
+        parsed = parse_float_slow(buffer, buffer + length);
+    }
+
+    return parsed == value;
+}
+
+char * format_float(float value, char * out)
+{
+    // snprintf's terminator would land past the end, so it writes to a copy
+    if (std::isnan(value) || std::isinf(value)) {
+        char buffer[format_float_chars + 1];
+        int length = snprintf(buffer, sizeof(buffer), "%g", value);
+
+        memcpy(out, buffer, length);
+        return out + length;
+    }
+
+    if (std::signbit(value)) {
+        *out++ = '-';
+        value = -value;
+    }
+
+    if (value == 0) {
+        *out++ = '0';
+        return out;
+    }
+
+    // exponent of the leading digit, log10 may be one off near powers of ten
+    int exponent = (int) std::floor(std::log10((double) value));
+    if (scale(value, -exponent) >= 10.0)
+        exponent++;
+    else if (scale(value, -exponent) < 1.0)
+        exponent--;
+
+    // more significant digits always read back closer, so the fewest that
+    // round trip are found by bisection; 9 digits always do when correctly
+    // rounded, which only snprintf guarantees
+    uint64_t mantissa = 0;
+    int digits = 0;
+
+    for (int low = 1, high = 9; low <= high; ) {
+        int middle = (low + high) / 2;
+        uint64_t candidate = (uint64_t) std::llround(scale(value, middle - 1 - exponent));
+
+        if (round_trips(candidate, exponent - (middle - 1), value)) {
+            mantissa = candidate;
+            digits = middle;
+            high = middle - 1;
+        }
+        else
+            low = middle + 1;
+    }
+
+    if (!digits) {
+        char buffer[32];
+        snprintf(buffer, sizeof(buffer), "%.8e", (double) value);
+
+        mantissa = 0;
+        for (const char * p = buffer; *p != 'e'; p++)
+            if (*p != '.')
+                mantissa = mantissa * 10 + (*p - '0');
+
+        exponent = atoi(strchr(buffer, 'e') + 1);
+        digits = 9;
+    }
+
+    // rounding up may have carried into a new leading digit ("9.99" to "10.0")
+    uint64_t limit = 1;
+    for (int i = 0; i < digits; i++)
+        limit *= 10;
+    if (mantissa >= limit) {
+        mantissa /= 10;
+        exponent++;
+    }
+
+    while (digits > 1 && mantissa % 10 == 0) {
+        mantissa /= 10;
+        digits--;
+    }
+
+    char text[9];
+    for (int i = digits - 1; i >= 0; i--) {
+        text[i] = char('0' + mantissa % 10);
+        mantissa /= 10;
+    }
+
+    if (exponent < -5 || exponent >= 9) {
+        *out++ = text[0];
+        if (digits > 1) {
+            *out++ = '.';
+            memcpy(out, text + 1, digits - 1);
+            out += digits - 1;
+        }
+        *out++ = 'e';
+        if (exponent < 0) {
+            *out++ = '-';
+            exponent = -exponent;
+        }
+        if (exponent >= 10)
+            *out++ = char('0' + exponent / 10);
+        *out++ = char('0' + exponent % 10);
+        return out;
+    }
+
+    if (exponent < 0) {
+        *out++ = '0';
+        *out++ = '.';
+        for (int i = -1; i > exponent; i--)
+            *out++ = '0';
+        memcpy(out, text, digits);
+        return out + digits;
+    }
+
+    if (exponent + 1 >= digits) {
+        memcpy(out, text, digits);
+        out += digits;
+        for (int i = digits; i <= exponent; i++)
+            *out++ = '0';
+        return out;
+    }
+
+    memcpy(out, text, exponent + 1);
+    out += exponent + 1;
+    *out++ = '.';
+    memcpy(out, text + exponent + 1, digits - exponent - 1);
+    return out + digits - exponent - 1;
+}
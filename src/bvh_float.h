@@ -0,0 +1,183 @@
+#pragma once
+
+#include <cstddef>
+#include <cstring>
+#include <stdint.h>
+
+#ifdef __SSE2__
+#  include <emmintrin.h>
+#endif
+
+// Decimal to float conversion for the motion values.
+//
+// parse_float() gives bit-identical results to strtof() (which is what
+// "stringstream >> float" ends up calling) but handles the common case without
+// copying the token or allocating. A decimal with at most 15 significant digits
+// and a small power of ten is converted exactly in double precision; the
+// rounding down to float is then only ambiguous when the double lands exactly
+// on a float halfway point, and those (and anything unusual such as
+// exponents out of range, hex, inf or nan) go to strtof.
+
+// Converts [begin, end) with strtof, used when the fast path cannot decide
+float parse_float_slow(const char * begin, const char * end);
+
+// Float to decimal conversion for writing: the shortest decimal (at most 9
+// significant digits) that reads back as exactly the same float, fixed point
+// for 1e-5 <= |value| < 1e9 and with an exponent otherwise ("1.5e-9").
+// Writes at most format_float_chars characters ("-0.0000100000025" takes
+// all 16), not null terminated, and returns the end; nothing past it is touched.
+static const size_t format_float_chars = 16;
+char * format_float(float value, char * out);
+
+namespace bvh_float
+{
+    static const double powers_of_ten[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+        1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20,
+        1e21, 1e22
+    };
+
+    // Exactly converts mantissa * 10^exponent, returns false if the result
+    // could differ from the correctly rounded float
+    inline bool decimal_to_float(uint64_t mantissa, int exponent, bool negative, float & value)
+    {
+        if (mantissa == 0) {
+            value = negative ? -0.0f : 0.0f;
+            return true;
+        }
+
+        // both operands are exact doubles so the result is correctly rounded
+        if (mantissa >= (uint64_t(1) << 53) || exponent < -22 || exponent > 22)
+            return false;
+
+        double d = double(mantissa);
+        d = exponent < 0 ? d / powers_of_ten[-exponent] : d * powers_of_ten[exponent];
+
+        // stay clear of float subnormals and overflow
+        if (d < 1.17549435e-38 || d > 3.40282346e+38)
+            return false;
+
+        // a double sitting on a float halfway point may have been rounded onto it
+        uint64_t bits;
+        memcpy(&bits, &d, sizeof(bits));
+        if ((bits & 0x1fffffff) == 0x10000000)
+            return false;
+
+        value = negative ? -float(d) : float(d);
+        return true;
+    }
+
+#ifdef __SSE2__
+    // Fixed precision numbers ("-123.456789") of up to 16 characters: classify all
+    // characters at once and accumulate the digits without per-character branches.
+    // "limit" is the end of the readable buffer, 16 bytes are loaded from begin.
+    inline bool parse_fixed_simd(const char * begin, const char * end, const char * limit, float & value)
+    {
+        bool negative = (*begin == '-');
+        const char * p = begin + negative;
+        int length = int(end - p);
+
+        if (length <= 0 || length > 16 || limit - p < 16)
+            return false;
+
+        __m128i chars = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+        __m128i digits = _mm_and_si128(_mm_cmpgt_epi8(chars, _mm_set1_epi8('0' - 1)),
+                                       _mm_cmplt_epi8(chars, _mm_set1_epi8('9' + 1)));
+        unsigned digit_mask = _mm_movemask_epi8(digits);
+        unsigned dot_mask = _mm_movemask_epi8(_mm_cmpeq_epi8(chars, _mm_set1_epi8('.')));
+
+        unsigned token_mask = (1u << length) - 1;
+        digit_mask &= token_mask;
+        dot_mask &= token_mask;
+
+        // everything must be a digit except for at most one dot
+        if ((digit_mask | dot_mask) != token_mask || (dot_mask & (dot_mask - 1)) || digit_mask == 0)
+            return false;
+
+        int dot = dot_mask ? __builtin_ctz(dot_mask) : length;
+
+        uint64_t mantissa = 0;
+        for (int i = 0; i < dot; i++)
+            mantissa = mantissa * 10 + (p[i] - '0');
+        for (int i = dot + 1; i < length; i++)
+            mantissa = mantissa * 10 + (p[i] - '0');
+
+        int exponent = dot_mask ? -(length - dot - 1) : 0;
+
+        return decimal_to_float(mantissa, exponent, negative, value);
+    }
+#endif
+
+    // General decimal syntax: [+-]digits[.digits][(e|E)[+-]digits]
+    inline bool parse_decimal(const char * p, const char * end, float & value)
+    {
+        bool negative = false;
+        if (p < end && (*p == '-' || *p == '+'))
+            negative = (*p++ == '-');
+
+        uint64_t mantissa = 0;
+        int significant = 0;
+        int exponent = 0;
+        bool any_digit = false;
+
+        for (; p < end && unsigned(*p - '0') < 10; p++) {
+            any_digit = true;
+            if (mantissa || *p != '0')
+                significant++;
+            mantissa = mantissa * 10 + (*p - '0');
+        }
+
+        if (p < end && *p == '.') {
+            for (p++; p < end && unsigned(*p - '0') < 10; p++) {
+                any_digit = true;
+                if (mantissa || *p != '0')
+                    significant++;
+                mantissa = mantissa * 10 + (*p - '0');
+                exponent--;
+            }
+        }
+
+        if (!any_digit || significant > 15)
+            return false;
+
+        if (p < end && (*p == 'e' || *p == 'E')) {
+            p++;
+            bool exponent_negative = false;
+            if (p < end && (*p == '-' || *p == '+'))
+                exponent_negative = (*p++ == '-');
+
+            if (p == end || p + 4 < end)
+                return false;
+
+            int e = 0;
+            for (; p < end && unsigned(*p - '0') < 10; p++)
+                e = e * 10 + (*p - '0');
+
+            exponent += exponent_negative ? -e : e;
+        }
+
+        if (p != end)
+            return false;
+
+        return decimal_to_float(mantissa, exponent, negative, value);
+    }
+}
+
+// Parses the token [begin, end) into value. "limit" is the end of the memory
+// that may be read, it allows the SIMD path to load past the token.
+inline float parse_float(const char * begin, const char * end, const char * limit)
+{
+    float value;
+
+#ifdef __SSE2__
+    if (bvh_float::parse_fixed_simd(begin, end, limit, value))
+        return value;
+#else
+    (void) limit;
+#endif
+
+    if (bvh_float::parse_decimal(begin, end, value))
+        return value;
+
+    return parse_float_slow(begin, end);
+}
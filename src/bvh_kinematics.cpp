@@ -0,0 +1,421 @@
+#include "bvh_loader.h"
+#include "bvh_kinematics.h"
+
+#include <cmath>
+
+// Rotation axes, used as template parameters
+enum { AXIS_X = 0, AXIS_Y = 1, AXIS_Z = 2 };
+
+// Post-multiplies m by a rotation about Axis given its cos/sin. This is what
+// glm::rotate does for a unit axis, but only the two affected columns change.
+template <int Axis>
+static inline void rotate_columns(AFFINE & m, float c, float s)
+{
+    const int a = Axis == AXIS_X ? 1 : (Axis == AXIS_Y ? 2 : 0);
+    const int b = Axis == AXIS_X ? 2 : (Axis == AXIS_Y ? 0 : 1);
+
+    for (int i = 0; i < 3; i++) {
+        float column_a = m.row[i][a];
+        m.row[i][a] = column_a * c + m.row[i][b] * s;
+        m.row[i][b] = m.row[i][b] * c - column_a * s;
+    }
+}
+
+// Post-multiplies m by a translation of value along Axis
+template <int Axis>
+static inline void translate_column(AFFINE & m, float value)
+{
+    for (int i = 0; i < 3; i++)
+        m.row[i].w = m.row[i][Axis] * value + m.row[i].w;
+}
+
+static inline const AFFINE & to_affine(const AFFINE & m)
+{
+    return m;
+}
+
+#ifdef BVH_SIMD_KINEMATICS
+// Same on the rows in registers: row * (c in lanes a and b) + swapped(row) * (s in lane a, -s in lane b)
+template <int Axis>
+static inline void rotate_columns(AFFINE_SIMD & m, float c, float s)
+{
+    const int a = Axis == AXIS_X ? 1 : (Axis == AXIS_Y ? 2 : 0);
+    const int b = Axis == AXIS_X ? 2 : (Axis == AXIS_Y ? 0 : 1);
+    const int swap = Axis == AXIS_X ? _MM_SHUFFLE(3, 1, 2, 0) :
+                     (Axis == AXIS_Y ? _MM_SHUFFLE(3, 0, 1, 2) : _MM_SHUFFLE(3, 2, 0, 1));
+
+    const __m128 lanes = _mm_castsi128_ps(_mm_setr_epi32(a == 0 || b == 0 ? -1 : 0, a == 1 || b == 1 ? -1 : 0,
+                                                         a == 2 || b == 2 ? -1 : 0, 0));
+    const __m128 sign_b = _mm_castsi128_ps(_mm_setr_epi32(b == 0 ? 0x80000000 : 0, b == 1 ? 0x80000000 : 0,
+                                                          b == 2 ? 0x80000000 : 0, 0));
+
+    __m128 cosine = _mm_or_ps(_mm_and_ps(lanes, _mm_set1_ps(c)), _mm_andnot_ps(lanes, _mm_set1_ps(1.0f)));
+    __m128 sine = _mm_xor_ps(_mm_and_ps(lanes, _mm_set1_ps(s)), sign_b);
+
+    for (int i = 0; i < 3; i++) {
+        __m128 swapped = _mm_shuffle_ps(m.row[i], m.row[i], swap);
+        m.row[i] = _mm_add_ps(_mm_mul_ps(m.row[i], cosine), _mm_mul_ps(swapped, sine));
+    }
+}
+
+// row.w += row[Axis] * value, the other lanes add 0
+template <int Axis>
+static inline void translate_column(AFFINE_SIMD & m, float value)
+{
+    __m128 translation = _mm_setr_ps(0.0f, 0.0f, 0.0f, value);
+
+    for (int i = 0; i < 3; i++) {
+        __m128 column = _mm_shuffle_ps(m.row[i], m.row[i], _MM_SHUFFLE(Axis, Axis, Axis, Axis));
+        m.row[i] = _mm_add_ps(_mm_mul_ps(column, translation), m.row[i]);
+    }
+}
+
+static inline AFFINE to_affine(const AFFINE_SIMD & m)
+{
+    AFFINE result;
+    m.store(result);
+    return result;
+}
+
+// One value in each lane's frame
+static inline __m128 lanes(const float * values, const size_t * rows)
+{
+    return _mm_setr_ps(values[rows[0]], values[rows[1]], values[rows[2]], values[rows[3]]);
+}
+
+// Same in every lane, with the cos/sin of each lane's frame
+template <int Axis>
+static inline void rotate_columns(AFFINE_X4 & m, __m128 c, __m128 s)
+{
+    const int a = Axis == AXIS_X ? 1 : (Axis == AXIS_Y ? 2 : 0);
+    const int b = Axis == AXIS_X ? 2 : (Axis == AXIS_Y ? 0 : 1);
+
+    for (int i = 0; i < 3; i++) {
+        __m128 column_a = m.m[i][a];
+        m.m[i][a] = _mm_add_ps(_mm_mul_ps(column_a, c), _mm_mul_ps(m.m[i][b], s));
+        m.m[i][b] = _mm_sub_ps(_mm_mul_ps(m.m[i][b], c), _mm_mul_ps(column_a, s));
+    }
+}
+
+template <int Axis>
+static inline void translate_column(AFFINE_X4 & m, __m128 value)
+{
+    for (int i = 0; i < 3; i++)
+        m.m[i][3] = _mm_add_ps(_mm_mul_ps(m.m[i][Axis], value), m.m[i][3]);
+}
+
+// Kernels build the transform in registers and store it once
+typedef AFFINE_SIMD LOCAL_AFFINE;
+#else
+typedef AFFINE LOCAL_AFFINE;
+#endif
+
+// Joints without channels, only the root reaches it as the others take the
+// fused path in advance_frame
+static AFFINE offset_kernel(const AFFINE & bind, const float *, const float *, const float *,
+                            const short *, unsigned int)
+{
+    return bind;
+}
+
+// Three rotations in the order A, B, C
+template <int A, int B, int C>
+struct rotation_kernel
+{
+    static AFFINE run(const AFFINE & bind, const float *, const float * sines, const float * cosines,
+                      const short *, unsigned int)
+    {
+        LOCAL_AFFINE m(bind);
+
+        rotate_columns<A>(m, cosines[0], sines[0]);
+        rotate_columns<B>(m, cosines[1], sines[1]);
+        rotate_columns<C>(m, cosines[2], sines[2]);
+
+        return to_affine(m);
+    }
+};
+
+// Xposition Yposition Zposition followed by three rotations in the order A, B, C
+template <int A, int B, int C>
+struct root_kernel
+{
+    static AFFINE run(const AFFINE & bind, const float * values, const float * sines, const float * cosines,
+                      const short *, unsigned int)
+    {
+        const glm::vec3 offset = bind.translation();
+        LOCAL_AFFINE m(glm::vec3(offset.x + values[0], offset.y + values[1], offset.z + values[2]));
+
+        rotate_columns<A>(m, cosines[3], sines[3]);
+        rotate_columns<B>(m, cosines[4], sines[4]);
+        rotate_columns<C>(m, cosines[5], sines[5]);
+
+        return to_affine(m);
+    }
+};
+
+#ifdef BVH_SIMD_KINEMATICS
+// The kernels above on four frames, one per lane
+
+static void offset_kernel_x4(const AFFINE & bind, const float *, const float *, const float *, const size_t *,
+                             const short *, unsigned int, AFFINE_X4 & local)
+{
+    local = AFFINE_X4(bind);
+}
+
+template <int A, int B, int C>
+struct rotation_kernel_x4
+{
+    static void run(const AFFINE & bind, const float *, const float * sines, const float * cosines,
+                    const size_t * rows, const short *, unsigned int, AFFINE_X4 & m)
+    {
+        m = AFFINE_X4(bind);
+
+        rotate_columns<A>(m, lanes(cosines, rows), lanes(sines, rows));
+        rotate_columns<B>(m, lanes(cosines + 1, rows), lanes(sines + 1, rows));
+        rotate_columns<C>(m, lanes(cosines + 2, rows), lanes(sines + 2, rows));
+    }
+};
+
+template <int A, int B, int C>
+struct root_kernel_x4
+{
+    static void run(const AFFINE & bind, const float * values, const float * sines, const float * cosines,
+                    const size_t * rows, const short *, unsigned int, AFFINE_X4 & m)
+    {
+        const glm::vec3 offset = bind.translation();
+        m = AFFINE_X4(AFFINE(glm::vec3(0.0f)));
+
+        for (int i = 0; i < 3; i++)
+            m.m[i][3] = _mm_add_ps(_mm_set1_ps(offset[i]), lanes(values + i, rows));
+
+        rotate_columns<A>(m, lanes(cosines + 3, rows), lanes(sines + 3, rows));
+        rotate_columns<B>(m, lanes(cosines + 4, rows), lanes(sines + 4, rows));
+        rotate_columns<C>(m, lanes(cosines + 5, rows), lanes(sines + 5, rows));
+    }
+};
+
+static void generic_fk_kernel_x4(const AFFINE & bind, const float * values,
+                                 const float * sines, const float * cosines, const size_t * rows,
+                                 const short * channels, unsigned int num_channels, AFFINE_X4 & matrix)
+{
+    matrix = AFFINE_X4(bind);
+
+    for (unsigned int i = 0; i < num_channels; i++) {
+        const short & channel = channels[i];
+
+        if (channel & BVH::Xposition)
+            translate_column<0>(matrix, lanes(values + i, rows));
+        else if (channel & BVH::Yposition)
+            translate_column<1>(matrix, lanes(values + i, rows));
+        else if (channel & BVH::Zposition)
+            translate_column<2>(matrix, lanes(values + i, rows));
+        else if (channel & BVH::Xrotation)
+            rotate_columns<AXIS_X>(matrix, lanes(cosines + i, rows), lanes(sines + i, rows));
+        else if (channel & BVH::Yrotation)
+            rotate_columns<AXIS_Y>(matrix, lanes(cosines + i, rows), lanes(sines + i, rows));
+        else if (channel & BVH::Zrotation)
+            rotate_columns<AXIS_Z>(matrix, lanes(cosines + i, rows), lanes(sines + i, rows));
+    }
+}
+#endif
+
+// Returns Kernel's instantiation for the rotation order a, b, c or NULL if the
+// three are not distinct axes
+template <typename KERNEL, template <int, int, int> class Kernel>
+static KERNEL rotation_order_kernel(int a, int b, int c)
+{
+    switch (a * 9 + b * 3 + c) {
+        case AXIS_X * 9 + AXIS_Y * 3 + AXIS_Z: return &Kernel<AXIS_X, AXIS_Y, AXIS_Z>::run;
+        case AXIS_X * 9 + AXIS_Z * 3 + AXIS_Y: return &Kernel<AXIS_X, AXIS_Z, AXIS_Y>::run;
+        case AXIS_Y * 9 + AXIS_X * 3 + AXIS_Z: return &Kernel<AXIS_Y, AXIS_X, AXIS_Z>::run;
+        case AXIS_Y * 9 + AXIS_Z * 3 + AXIS_X: return &Kernel<AXIS_Y, AXIS_Z, AXIS_X>::run;
+        case AXIS_Z * 9 + AXIS_X * 3 + AXIS_Y: return &Kernel<AXIS_Z, AXIS_X, AXIS_Y>::run;
+        case AXIS_Z * 9 + AXIS_Y * 3 + AXIS_X: return &Kernel<AXIS_Z, AXIS_Y, AXIS_X>::run;
+    }
+
+    return NULL;
+}
+
+// Axis of a rotation channel, -1 for anything else
+static int rotation_axis(short channel)
+{
+    switch (channel) {
+        case BVH::Xrotation: return AXIS_X;
+        case BVH::Yrotation: return AXIS_Y;
+        case BVH::Zrotation: return AXIS_Z;
+    }
+
+    return -1;
+}
+
+// Picks among one set of kernels, scalar or four frame, for a channel layout
+template <typename KERNEL, template <int, int, int> class Rotation, template <int, int, int> class Root>
+static KERNEL select_kernel(unsigned int num_channels, const short * channels, KERNEL offset, KERNEL generic)
+{
+    KERNEL kernel = NULL;
+
+    if (num_channels == 0)
+        kernel = offset;
+    else if (num_channels == 3)
+        kernel = rotation_order_kernel<KERNEL, Rotation>(rotation_axis(channels[0]),
+                                                         rotation_axis(channels[1]),
+                                                         rotation_axis(channels[2]));
+    else if (num_channels == 6 &&
+             channels[0] == BVH::Xposition && channels[1] == BVH::Yposition && channels[2] == BVH::Zposition)
+        kernel = rotation_order_kernel<KERNEL, Root>(rotation_axis(channels[3]),
+                                                     rotation_axis(channels[4]),
+                                                     rotation_axis(channels[5]));
+
+    return kernel ? kernel : generic;
+}
+
+FK_KERNEL select_fk_kernel(unsigned int num_channels, const short * channels)
+{
+    return select_kernel<FK_KERNEL, rotation_kernel, root_kernel>(num_channels, channels,
+                                                                  offset_kernel, generic_fk_kernel);
+}
+
+#ifdef BVH_SIMD_KINEMATICS
+FK_KERNEL_X4 select_fk_kernel_x4(unsigned int num_channels, const short * channels)
+{
+    return select_kernel<FK_KERNEL_X4, rotation_kernel_x4, root_kernel_x4>(num_channels, channels,
+                                                                           offset_kernel_x4, generic_fk_kernel_x4);
+}
+#endif
+
+AFFINE generic_fk_kernel(const AFFINE & bind, const float * values,
+                         const float * sines, const float * cosines,
+                         const short * channels, unsigned int num_channels)
+{
+    // start from the joint's offset
+    LOCAL_AFFINE matrix(bind);
+
+    // here we transform joint's local matrix with each specified channel's values
+    // which are read from motion data
+    for (unsigned int i = 0; i < num_channels; i++)
+    {
+        // channel alias
+        const short& channel = channels[i];
+
+        // extract value from motion data
+        float value = values[i];
+
+        if (channel & BVH::Xposition)
+            translate_column<0>(matrix, value);
+        else if (channel & BVH::Yposition)
+            translate_column<1>(matrix, value);
+        else if (channel & BVH::Zposition)
+            translate_column<2>(matrix, value);
+        else if (channel & BVH::Xrotation)
+            rotate_columns<AXIS_X>(matrix, cosines[i], sines[i]);
+        else if (channel & BVH::Yrotation)
+            rotate_columns<AXIS_Y>(matrix, cosines[i], sines[i]);
+        else if (channel & BVH::Zrotation)
+            rotate_columns<AXIS_Z>(matrix, cosines[i], sines[i]);
+    }
+
+    return to_affine(matrix);
+}
+
+void BVH::bind_skeleton()
+{
+    for (unsigned int joint = 0; joint < skeleton.num_joints; joint++) {
+        unsigned int num_channels = skeleton.num_channels[joint];
+        const short * channels = num_channels ? &skeleton.channels_order[skeleton.channel_start[joint]] : NULL;
+
+        skeleton.bind[joint] = AFFINE(skeleton.offset[joint]);
+        skeleton.kernel[joint] = select_fk_kernel(num_channels, channels);
+#ifdef BVH_SIMD_KINEMATICS
+        skeleton.kernel_x4[joint] = select_fk_kernel_x4(num_channels, channels);
+#endif
+    }
+}
+
+void BVH::advance_frame(const float * frame_data, const float * sines, const float * cosines, AFFINE * world)
+{
+    for (unsigned int joint = 0; joint < skeleton.num_joints; joint++) {
+        const unsigned int num_channels = skeleton.num_channels[joint];
+        const unsigned int channel_start = skeleton.channel_start[joint];
+        const short * channels = num_channels ? &skeleton.channels_order[channel_start] : NULL;
+
+        // parents come first in the skeleton, so theirs is already computed
+        int parent = skeleton.parent[joint];
+
+        // end sites only move by their offset, no local transform to build
+        if (num_channels == 0 && parent >= 0) {
+            world[joint] = translate(world[parent], skeleton.offset[joint]);
+            continue;
+        }
+
+        // the joint's local transform from its values in this frame
+        AFFINE matrix = skeleton.kernel[joint](skeleton.bind[joint], frame_data + channel_start,
+                                               sines + channel_start, cosines + channel_start,
+                                               channels, num_channels);
+
+        // then we apply parent's world matrix to this joint's LTM (local tr. mtx. :)
+        world[joint] = parent >= 0 ? world[parent] * matrix : matrix;
+    }
+}
+
+#ifdef BVH_SIMD_KINEMATICS
+const unsigned int BVH::simd_frames;
+
+void BVH::advance_frames_simd(const float * frame_data, const float * sines, const float * cosines,
+                              unsigned int count, AFFINE_X4 * world)
+{
+    const unsigned int stride = motionData.num_motion_channels;
+
+    // the lanes past a short batch repeat its last frame
+    size_t rows[simd_frames];
+    for (unsigned int lane = 0; lane < simd_frames; lane++)
+        rows[lane] = (size_t) std::min(lane, count - 1) * stride;
+
+    for (unsigned int joint = 0; joint < skeleton.num_joints; joint++) {
+        const unsigned int num_channels = skeleton.num_channels[joint];
+        const unsigned int channel_start = skeleton.channel_start[joint];
+        const short * channels = num_channels ? &skeleton.channels_order[channel_start] : NULL;
+
+        int parent = skeleton.parent[joint];
+
+        // end sites only move by their offset
+        if (num_channels == 0 && parent >= 0) {
+            world[joint] = translate(world[parent], skeleton.offset[joint]);
+            continue;
+        }
+
+        AFFINE_X4 local;
+        skeleton.kernel_x4[joint](skeleton.bind[joint], frame_data + channel_start, sines + channel_start,
+                                  cosines + channel_start, rows, channels, num_channels, local);
+
+        world[joint] = parent >= 0 ? world[parent] * local : local;
+    }
+}
+
+void BVH::preprocess_frames_simd(unsigned int first, unsigned int last, const float * sines, const float * cosines,
+                                 BOUNDS & frame_bounds, float & max_error)
+{
+    const unsigned int stride = motionData.num_motion_channels;
+
+    // scratch world matrices private to this range
+    vector<AFFINE_X4> world(skeleton.num_joints);
+
+    for (unsigned int frame_number = first; frame_number < last; frame_number += simd_frames) {
+        unsigned int count = std::min(simd_frames, last - frame_number);
+        const float * frame_data = motionData.data + (size_t) frame_number * stride;
+        size_t trig_row = (size_t) (frame_number - first) * stride;
+
+        advance_frames_simd(frame_data, sines + trig_row, cosines + trig_row, count, &world[0]);
+
+        for (unsigned int joint = 0; joint < skeleton.num_joints; joint++) {
+            glm::vec3 vertices[simd_frames];
+            world[joint].translations(vertices);
+
+            for (unsigned int frame = 0; frame < count; frame++) {
+                frame_bounds.add(vertices[frame]);
+
+                max_error = std::max(max_error, poses.set(joint, frame_number + frame, vertices[frame]));
+            }
+        }
+    }
+}
+#endif
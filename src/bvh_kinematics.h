@@ -0,0 +1,228 @@
+#pragma once
+
+#include "glm/glm.hpp"
+#include "glm/ext.hpp"
+
+#include "bvh_trig.h"
+
+#ifdef __SSE2__
+#  include <emmintrin.h>
+#  define BVH_SIMD_KINEMATICS 1
+#endif
+
+// Rigid transform as the top three rows of its 4x4 matrix: the rotation in
+// xyz and the translation in w. The bottom row is always (0, 0, 0, 1) and is
+// not stored.
+struct AFFINE
+{
+    glm::vec4 row[3];
+
+    AFFINE() {}
+
+    // Pure translation
+    explicit AFFINE(const glm::vec3 & translation) {
+        row[0] = glm::vec4(1.0, 0.0, 0.0, translation.x);
+        row[1] = glm::vec4(0.0, 1.0, 0.0, translation.y);
+        row[2] = glm::vec4(0.0, 0.0, 1.0, translation.z);
+    }
+
+    glm::vec3 translation() const { return glm::vec3(row[0].w, row[1].w, row[2].w); }
+
+    glm::mat4 to_mat4() const {
+        return glm::transpose(glm::mat4(row[0], row[1], row[2], glm::vec4(0.0, 0.0, 0.0, 1.0)));
+    }
+};
+
+#ifdef BVH_SIMD_KINEMATICS
+// AFFINE with each row in an SSE register
+struct AFFINE_SIMD
+{
+    __m128 row[3];
+
+    AFFINE_SIMD() {}
+
+    // Pure translation
+    explicit AFFINE_SIMD(const glm::vec3 & translation) {
+        row[0] = _mm_setr_ps(1.0f, 0.0f, 0.0f, translation.x);
+        row[1] = _mm_setr_ps(0.0f, 1.0f, 0.0f, translation.y);
+        row[2] = _mm_setr_ps(0.0f, 0.0f, 1.0f, translation.z);
+    }
+
+    explicit AFFINE_SIMD(const AFFINE & affine) {
+        for (int i = 0; i < 3; i++)
+            row[i] = _mm_loadu_ps(&affine.row[i].x);
+    }
+
+    void store(AFFINE & affine) const {
+        for (int i = 0; i < 3; i++)
+            _mm_storeu_ps(&affine.row[i].x, row[i]);
+    }
+};
+
+// a * b. Each element sums its terms in the order of the mat4 product so the
+// results match it; the terms of the constant bottom row are skipped.
+inline AFFINE_SIMD operator*(const AFFINE_SIMD & a, const AFFINE_SIMD & b)
+{
+    const __m128 w_mask = _mm_castsi128_ps(_mm_setr_epi32(0, 0, 0, -1));
+    AFFINE_SIMD result;
+
+    for (int i = 0; i < 3; i++) {
+        __m128 x = _mm_shuffle_ps(a.row[i], a.row[i], _MM_SHUFFLE(0, 0, 0, 0));
+        __m128 y = _mm_shuffle_ps(a.row[i], a.row[i], _MM_SHUFFLE(1, 1, 1, 1));
+        __m128 z = _mm_shuffle_ps(a.row[i], a.row[i], _MM_SHUFFLE(2, 2, 2, 2));
+
+        __m128 sum = _mm_add_ps(_mm_add_ps(_mm_mul_ps(b.row[0], x), _mm_mul_ps(b.row[1], y)),
+                                _mm_mul_ps(b.row[2], z));
+        result.row[i] = _mm_add_ps(sum, _mm_and_ps(a.row[i], w_mask));
+    }
+
+    return result;
+}
+#endif
+
+#ifdef BVH_SIMD_KINEMATICS
+// a * (pure translation t): the rotation is kept and only the translation
+// takes products, summed in the same order as the full product
+inline AFFINE_SIMD translate(const AFFINE_SIMD & a, const glm::vec3 & t)
+{
+    const __m128 translation = _mm_setr_ps(t.x, t.y, t.z, 1.0f);
+    AFFINE_SIMD result;
+
+    for (int i = 0; i < 3; i++) {
+        __m128 products = _mm_mul_ps(a.row[i], translation);
+        __m128 sum = _mm_add_ps(products, _mm_shuffle_ps(products, products, _MM_SHUFFLE(1, 1, 1, 1)));
+        sum = _mm_add_ps(sum, _mm_shuffle_ps(products, products, _MM_SHUFFLE(2, 2, 2, 2)));
+        sum = _mm_add_ps(sum, _mm_shuffle_ps(products, products, _MM_SHUFFLE(3, 3, 3, 3)));
+
+        // x, y, z of the row and the sum in w
+        __m128 zw = _mm_shuffle_ps(a.row[i], sum, _MM_SHUFFLE(0, 0, 2, 2));
+        result.row[i] = _mm_shuffle_ps(a.row[i], zw, _MM_SHUFFLE(2, 0, 1, 0));
+    }
+
+    return result;
+}
+#endif
+
+#ifdef BVH_SIMD_KINEMATICS
+// One transform in four frames at once: each element is a register holding
+// it in one frame per lane, so the frames are combined by plain vertical
+// operations and never shuffled
+struct AFFINE_X4
+{
+    __m128 m[3][4];
+
+    AFFINE_X4() {}
+
+    // The same transform in every lane
+    explicit AFFINE_X4(const AFFINE & affine) {
+        for (int i = 0; i < 3; i++)
+            for (int j = 0; j < 4; j++)
+                m[i][j] = _mm_set1_ps(affine.row[i][j]);
+    }
+
+    // Translation of every lane
+    void translations(glm::vec3 * translation) const {
+        float x[4], y[4], z[4];
+        _mm_storeu_ps(x, m[0][3]);
+        _mm_storeu_ps(y, m[1][3]);
+        _mm_storeu_ps(z, m[2][3]);
+
+        for (int lane = 0; lane < 4; lane++)
+            translation[lane] = glm::vec3(x[lane], y[lane], z[lane]);
+    }
+};
+
+// a * b in every lane, each element summed in the same order as for AFFINE_SIMD
+inline AFFINE_X4 operator*(const AFFINE_X4 & a, const AFFINE_X4 & b)
+{
+    AFFINE_X4 result;
+
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 4; j++) {
+            __m128 sum = _mm_add_ps(_mm_add_ps(_mm_mul_ps(b.m[0][j], a.m[i][0]), _mm_mul_ps(b.m[1][j], a.m[i][1])),
+                                    _mm_mul_ps(b.m[2][j], a.m[i][2]));
+            result.m[i][j] = j == 3 ? _mm_add_ps(sum, a.m[i][3]) : sum;
+        }
+    }
+
+    return result;
+}
+
+// a * (pure translation t) in every lane
+inline AFFINE_X4 translate(const AFFINE_X4 & a, const glm::vec3 & t)
+{
+    const __m128 x = _mm_set1_ps(t.x), y = _mm_set1_ps(t.y), z = _mm_set1_ps(t.z);
+    AFFINE_X4 result = a;
+
+    for (int i = 0; i < 3; i++) {
+        __m128 sum = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a.m[i][0], x), _mm_mul_ps(a.m[i][1], y)),
+                                _mm_mul_ps(a.m[i][2], z));
+        result.m[i][3] = _mm_add_ps(sum, a.m[i][3]);
+    }
+
+    return result;
+}
+#endif
+
+// a * b, same order as for AFFINE_SIMD
+inline AFFINE operator*(const AFFINE & a, const AFFINE & b)
+{
+    AFFINE result;
+
+#ifdef BVH_SIMD_KINEMATICS
+    // the compiler does not vectorize the scalar version well
+    (AFFINE_SIMD(a) * AFFINE_SIMD(b)).store(result);
+#else
+    for (int i = 0; i < 3; i++) {
+        result.row[i] = b.row[0] * a.row[i].x + b.row[1] * a.row[i].y + b.row[2] * a.row[i].z;
+        result.row[i].w += a.row[i].w;
+    }
+#endif
+
+    return result;
+}
+
+// a * (pure translation t), same order as above
+inline AFFINE translate(const AFFINE & a, const glm::vec3 & t)
+{
+    AFFINE result;
+
+#ifdef BVH_SIMD_KINEMATICS
+    translate(AFFINE_SIMD(a), t).store(result);
+#else
+    for (int i = 0; i < 3; i++) {
+        result.row[i] = a.row[i];
+        result.row[i].w = a.row[i].x * t.x + a.row[i].y * t.y + a.row[i].z * t.z + a.row[i].w;
+    }
+#endif
+
+    return result;
+}
+
+// Builds the local transform of one joint from its channel values of one
+// frame, applied onto the joint's bind transform (its constant offset, baked
+// at load). sines/cosines hold the precomputed sin/cos of each value (see
+// sincos_degrees), rotations read those instead of evaluating trigonometry.
+typedef AFFINE (*FK_KERNEL)(const AFFINE & bind, const float * values,
+                            const float * sines, const float * cosines,
+                            const short * channels, unsigned int num_channels);
+
+// Returns the kernel for a joint's channel layout. The common layouts (no
+// channels, 3 rotations, 3 positions followed by 3 rotations) get kernels
+// specialized for their rotation order; anything else walks the channels.
+FK_KERNEL select_fk_kernel(unsigned int num_channels, const short * channels);
+
+// Kernel for any channel layout
+AFFINE generic_fk_kernel(const AFFINE & bind, const float * values,
+                         const float * sines, const float * cosines,
+                         const short * channels, unsigned int num_channels);
+
+#ifdef BVH_SIMD_KINEMATICS
+// Same for four frames, one per lane: the values of lane i's frame start
+// rows[i] floats after values (and sines, cosines)
+typedef void (*FK_KERNEL_X4)(const AFFINE & bind, const float * values,
+                             const float * sines, const float * cosines, const size_t * rows,
+                             const short * channels, unsigned int num_channels, AFFINE_X4 & local);
+
+FK_KERNEL_X4 select_fk_kernel_x4(unsigned int num_channels, const short * channels);
+#endif
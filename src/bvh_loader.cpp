@@ -1,69 +1,300 @@
 #include "bvh_loader.h"
+#include "parallel.h"
 
-BVH::BVH(const char * filename)
+#include <chrono>
+#include <climits>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#endif
+
+// Motion blocks smaller than this are parsed on the calling thread
+static const size_t parallel_motion_bytes = 1 << 20;
+
+// Number of frames evaluated by one preprocessing task
+static const unsigned int preprocess_task_frames = 512;
+
+// Frames whose sin/cos are precomputed at once, a multiple of BVH::simd_frames
+static const unsigned int trig_batch_frames = 64;
+
+// Frames evaluated for the bounds of a lazily evaluated clip
+static const unsigned int lazy_bounds_samples = 1024;
+
+// Frames evaluated ahead of the last requested one, at most half the frame cache
+static const unsigned int prefetch_frames = 120;
+
+// Frames in the first batch a progressive load publishes, later batches
+// double up to preprocess_task_frames
+static const unsigned int progressive_first_frames = 64;
+
+// Address space reserved for the motion of a tailed file
+static const size_t tail_reserve_bytes = (size_t) 1 << (sizeof(size_t) >= 8 ? 32 : 28);
+
+// Bytes read from a tailed file at once, and how long to wait for it to
+// grow before checking again
+static const size_t tail_read_bytes = 64 << 10;
+static const int tail_poll_ms = 50;
+
+// Bytes of motion text formatted by one task of BVH::write_bvh and written at once
+static const size_t write_chunk_bytes = 4 << 20;
+
+const string BVH::no_error;
+
+BVH::BVH(const char * filename, const LOAD_OPTIONS & options) :
+    BVH(filename, options, NULL)
 {
-	ifstream infile(filename);
-	string line;
+}
 
-	if(infile.is_open()) {
-		while(infile.good()) {
-			infile >> line;
-            if( trim(line) == "HIERARCHY" )
-                loadhierarchy(infile);
-            break;
-		}
+BVH::BVH(const char * filename, const LOAD_OPTIONS & options, const BVH * previous) :
+    skeleton(arena)
+{
+    source_name = filename;
+    load_options = options;
+    rootJoint = NULL;
+    motion_lines = NULL;
+    line_channels = 0;
+    text_frames = 0;
+    first_line = 0;
+    line_step = 1;
+    frame_offsets = NULL;
+    preprocess_rate = 0;
+    frames_changed = 0;
+    position_error = 0;
+    prefetch_frame = UINT_MAX;
+    prefetch_requested = false;
+    prefetch_stop = false;
+    ready_frames = 0;
+    loading_motion = false;
+    load_stop = false;
+
+    if (!sourceFile.open(filename)) {
+        load_error = string("cannot open ") + filename;
+        return;
+    }
 
-		infile.close();
+    // indexed frames are parsed on demand, so the poses have to be too
+    if (load_options.frame_index) {
+        load_options.lazy_kinematics = true;
+        load_options.progressive = false;
     }
-    else
-        exit(1);
 
-    preprocess_motion();
+    // a tailed file has no known end, every frame is loaded as it comes and
+    // only the poses shown are kept
+    if (load_options.tail) {
+        load_options.lazy_kinematics = true;
+        load_options.progressive = false;
+        load_options.frame_index = false;
+        load_options.first_frame = 0;
+        load_options.last_frame = UINT_MAX;
+        load_options.frame_stride = 1;
+    }
+
+    // a sidecar made from this exact text skips parsing entirely; header-only
+    // and indexed loads do not read the whole text, not even to hash it, and the sidecar
+    // holds every joint and frame so a subset or selection of frames is parsed
+    string cache_name;
+    uint64_t source_hash = 0;
+    uint64_t source_size = 0;
+    int64_t source_mtime = 0;
+
+    bool every_frame = load_options.first_frame == 0 && load_options.last_frame == UINT_MAX &&
+                       load_options.frame_stride <= 1;
+
+    if (load_options.use_cache && !load_options.header_only && !load_options.frame_index &&
+        !load_options.tail && load_options.joints.empty() && every_frame) {
+        cache_name = cache_filename(filename);
+        file_stamp(filename, source_size, source_mtime);
+        source_size = sourceFile.size();
+
+        // a progressive load trusts a sidecar of a source with the same size and
+        // modification time, as the frame index does, so the first frame is not
+        // held up by reading both files; on a miss the text is hashed on the load thread
+        if (!load_options.progressive)
+            source_hash = hash_bytes(sourceFile.begin(), source_size);
+
+        if (load_cache(cache_name, load_options.progressive ? NULL : &source_hash, source_size, source_mtime)) {
+            sourceFile.close();
+            bind_skeleton();
+            build_joints();
+
+            if (load_options.progressive) {
+                start_progressive(string(), 0);
+                return;
+            }
+
+            preprocess_changed(previous);
+            ready_frames = motionData.num_frames.load();
+            return;
+        }
+    }
+
+    Tokenizer tokens(sourceFile.begin(), sourceFile.end());
+
+    if (tokens.next() == "HIERARCHY")
+        loadhierarchy(tokens);
+
+    if (good() && (!skeleton.num_joints || (!motionData.data && !motion_lines)))
+        load_error = string(filename) + " has no ROOT joint or MOTION section";
+
+    if (!good())
+        return;
+
+    bind_skeleton();
+    build_joints();
+
+    if (load_options.header_only) {
+        sourceFile.close();
+        return;
+    }
+
+    // the frame lines are read from the end of the header on, as the file grows
+    if (load_options.tail) {
+        start_tail(filename);
+        return;
+    }
+
+    // the source stays mapped for the frames parsed later
+    if (load_options.frame_index) {
+        if (open_index(filename)) {
+            preprocess_motion();
+            ready_frames = motionData.num_frames.load();
+        }
+        return;
+    }
+
+    // the frame lines are still to be parsed, the sidecar is saved once they are
+    if (load_options.progressive) {
+        start_progressive(cache_name, source_mtime);
+        return;
+    }
+
+    if (!cache_name.empty())
+        save_cache(cache_name, source_hash, source_size, source_mtime);
+
+    sourceFile.close();
+
+    preprocess_changed(previous);
+    ready_frames = motionData.num_frames.load();
 }
 
 BVH::~BVH()
 {
-	delete rootJoint;
-    delete min_animation;
-    delete max_animation;
+    if (load_thread.joinable()) {
+        load_stop = true;
+        load_thread.join();
+    }
+
+    if (prefetch_thread.joinable()) {
+        {
+            std::lock_guard<std::mutex> guard(prefetch_lock);
+            prefetch_stop = true;
+        }
+        prefetch_signal.notify_one();
+        prefetch_thread.join();
+    }
+}
+
+void BVH::wait_frames(unsigned int count)
+{
+    std::unique_lock<std::mutex> guard(ready_lock);
+    ready_signal.wait(guard, [&] { return frames_ready() >= count || !loading(); });
 }
 
-void BVH::loadhierarchy(istream& stream)
+BVH * BVH::reloaded()
 {
-    string tmp;
+    // positions are only reused once every frame is in
+    LOAD_OPTIONS options = load_options;
+    options.progressive = false;
 
-    while(stream.good())
-    {
-        stream >> tmp;
+    return new BVH(source_name.c_str(), options, loading() ? NULL : this);
+}
+
+bool BVH::same_hierarchy(const BVH & other) const
+{
+    const SKELETON & a = skeleton;
+    const SKELETON & b = other.skeleton;
+
+    if (a.num_joints != b.num_joints || line_channels != other.line_channels ||
+        motionData.num_motion_channels != other.motionData.num_motion_channels ||
+        channel_columns != other.channel_columns ||
+        a.channels_order.size() != b.channels_order.size() ||
+        !std::equal(a.channels_order.begin(), a.channels_order.end(), b.channels_order.begin()))
+        return false;
+
+    for (unsigned int joint = 0; joint < a.num_joints; joint++) {
+        if (a.parent[joint] != b.parent[joint] || a.offset[joint] != b.offset[joint] ||
+            a.num_channels[joint] != b.num_channels[joint] || a.channel_start[joint] != b.channel_start[joint] ||
+            strcmp(a.name[joint], b.name[joint]) != 0)
+            return false;
+    }
+
+    return true;
+}
+
+vector<BVH *> BVH::load_many(const vector<string> & filenames, const LOAD_OPTIONS & options)
+{
+    // files are the unit of work, so every file loads on a single worker
+    LOAD_OPTIONS file_options = options;
+    file_options.threads = 1;
+
+    vector<BVH *> clips(filenames.size(), NULL);
 
-        if (trim(tmp) == "ROOT")
-            rootJoint = loadjoint(stream);
-        else if(trim(tmp) == "MOTION")
-            loadmotion(stream);
+    parallel_for(filenames.size(), options.threads, [&](unsigned int i) {
+        clips[i] = new BVH(filenames[i].c_str(), file_options);
+    });
+
+    return clips;
+}
+
+void BVH::loadhierarchy(Tokenizer& tokens)
+{
+    while(tokens.good())
+    {
+        TOKEN tmp = tokens.next();
+
+        if (tmp == "ROOT")
+            loadjoint(tokens);
+        else if(tmp == "MOTION") {
+            if (!project_joints())
+                return;
+            loadmotion(tokens);
+        }
     }
 }
 
 void BVH::save_bvh()
 {
-    ofstream outfile("output.bvh");
+    write_bvh("output.bvh", load_options.threads);
+}
 
-    if (outfile.is_open()) {
-        dumphierarchy(outfile);
-        outfile.close();
-    }
+bool BVH::write_bvh(const char * filename, unsigned int threads)
+{
+    if (!has_motion())
+        return false;
+
+    // a reader of the file never sees it half written
+    AtomicFile file;
+    if (!file.open(filename))
+        return false;
 
+    stringstream hierarchy;
+    dumphierarchy(hierarchy);
+
+    return dumpmotion(file, hierarchy.str(), threads) && file.commit();
 }
 
 void BVH::dumphierarchy(ostream& stream)
 {
-    stream << "HIERARCHY" << endl;
+    stream << "HIERARCHY\n";
     
     int tab_level = 0;
 
     dumpjoint(rootJoint, stream, tab_level);
-
-    // Print motion data
-    dumpmotion(stream);
 }
 
 void BVH::print_tab(ostream& stream, int & tab_level)
@@ -74,25 +305,27 @@ void BVH::print_tab(ostream& stream, int & tab_level)
 
 void BVH::dumpjoint(JOINT * parent_joint, ostream& stream, int & tab_level)
 {
+    char number[format_float_chars];
+
     print_tab(stream, tab_level);
     // Check if end site
     if (parent_joint->children.size() == 0)
-        stream << "End Site" << endl;
+        stream << "End Site\n";
     else if (parent_joint->parent == NULL)
-        stream << "ROOT " << parent_joint->name << endl;
+        stream << "ROOT " << parent_joint->name << '\n';
     else
-        stream << "JOINT " << parent_joint->name << endl;
+        stream << "JOINT " << parent_joint->name << '\n';
 
     print_tab(stream, tab_level);
-    stream << "{" << endl;
+    stream << "{\n";
 
     tab_level++;
     // Print OFFSET Data
     print_tab(stream, tab_level);
     stream << "OFFSET ";
-    stream << parent_joint->offset.x << " ";
-    stream << parent_joint->offset.y << " ";
-    stream << parent_joint->offset.z << endl;
+    stream.write(number, format_float(parent_joint->offset.x, number) - number) << " ";
+    stream.write(number, format_float(parent_joint->offset.y, number) - number) << " ";
+    stream.write(number, format_float(parent_joint->offset.z, number) - number) << '\n';
 
     if (parent_joint->num_channels) {
         // Print CHANNELS Data
@@ -107,7 +340,7 @@ void BVH::dumpjoint(JOINT * parent_joint, ostream& stream, int & tab_level)
                 stream << " ";
         }
 
-        stream << endl;
+        stream << '\n';
     }
     tab_level--;
 
@@ -118,93 +351,131 @@ void BVH::dumpjoint(JOINT * parent_joint, ostream& stream, int & tab_level)
     }
 
     print_tab(stream, tab_level);
-    stream << "}" << endl;   
+    stream << "}\n";
 }
 
-void BVH::dumpmotion(ostream& stream)
+bool BVH::dumpmotion(AtomicFile & file, const string & hierarchy, unsigned int threads)
 {
-    stream << "MOTION" << endl;
-    stream << "Frames: " << motionData.num_frames << endl;
-    stream << "Frame Time: " << motionData.frame_time << endl;
+    // a clip still loading, progressively or tailed, writes the frames ready so far
+    unsigned int num_frames = frames_ready();
+    unsigned int channels = motionData.num_motion_channels;
+    load_frames(0, num_frames);
+
+    char number[format_float_chars];
+    stringstream header;
+    header << hierarchy << "MOTION\n";
+    header << "Frames: " << num_frames << '\n';
+    header << "Frame Time: ";
+    header.write(number, format_float(motionData.frame_time, number) - number) << '\n';
+
+    string header_text = header.str();
+    if (!file.write(header_text.data(), header_text.size()))
+        return false;
+
+    // each chunk of frames is formatted by one task into its own buffer, a
+    // round of chunks at a time so the memory held stays bounded; a line
+    // takes at most every value with the space or newline after it, and the
+    // newline alone without channels
+    size_t line_bytes = (size_t) channels * (format_float_chars + 1) + 1;
+    unsigned int chunk_frames = (unsigned int) std::max<size_t>(write_chunk_bytes / line_bytes, 1);
+    unsigned int num_chunks = (num_frames + chunk_frames - 1) / chunk_frames;
+    unsigned int round_chunks = std::min(worker_count(threads), num_chunks);
+
+    vector<vector<char> > buffers(round_chunks);
+    vector<size_t> lengths(round_chunks);
+
+    for (unsigned int round = 0; round < num_chunks; round += round_chunks) {
+        unsigned int count = std::min(round_chunks, num_chunks - round);
+
+        parallel_for(count, threads, [&](unsigned int i) {
+            unsigned int first = (round + i) * chunk_frames;
+            unsigned int last = std::min(first + chunk_frames, num_frames);
+
+            buffers[i].resize((size_t) (last - first) * line_bytes);
+            char * out = buffers[i].data();
+
+            for (unsigned int frame = first; frame < last; frame++) {
+                const float * values = motionData.data + (size_t) frame * channels;
+
+                for (unsigned int channel = 0; channel < channels; channel++) {
+                    if (channel)
+                        *out++ = ' ';
+                    out = format_float(values[channel], out);
+                }
+                // End of frame
+                *out++ = '\n';
+            }
 
-    for (unsigned int frame = 0; frame < motionData.num_frames; frame++) {
-        for (unsigned int channel = 0; channel < motionData.num_motion_channels; channel++) {
-            int index = frame * motionData.num_motion_channels + channel;
-            stream << motionData.data[index];
+            lengths[i] = out - buffers[i].data();
+        });
 
-            if (channel + 1 < motionData.num_motion_channels)
-                stream << " ";
-        }
-        // End of frame
-        stream << endl;
+        for (unsigned int i = 0; i < count; i++)
+            if (!file.write(buffers[i].data(), lengths[i]))
+                return false;
     }
+
+    return true;
 }
 
-JOINT * BVH::loadjoint(istream& stream, JOINT* parent)
+unsigned int BVH::loadjoint(Tokenizer& tokens, int parent)
 {
-	JOINT* joint = new JOINT;
-	joint->parent = parent;
-
 	// load joint name
-    stream >> joint->name;
+    TOKEN joint_name = tokens.next();
+    unsigned int joint = skeleton.add_joint(parent, joint_name.data, joint_name.length);
 
-    // load identity matrix
-    joint->matrix = glm::mat4(1.0);
-
-    std::string tmp;
-
-    static int chanel_global_index = 0;
     unsigned channel_order_index = 0;
 
-    while(stream.good()) {
+    while(tokens.good()) {
 
-    	stream >> tmp;
-        tmp = trim(tmp);
+    	TOKEN tmp = tokens.next();
+
+        if (tmp.empty())
+            break;
 
         // loading channel order
-        char c = tmp.at(0);
-        if (c == 'X' || c == 'Y' || c == 'Z')
-	        joint->channels_order[channel_order_index++] = channel_string_to_index(tmp);
+        char c = tmp.data[0];
+        if (c == 'X' || c == 'Y' || c == 'Z') {
+            unsigned int channel = skeleton.channel_start[joint] + channel_order_index++;
+	        skeleton.channels_order[channel] = channel_string_to_index(tmp);
+        }
 	    // reading an offset values
-	    else if (tmp == "OFFSET")
-            stream  >> joint->offset.x >> joint->offset.y >> joint->offset.z;
-
+	    else if (tmp == "OFFSET") {
+            tokens.next_float(skeleton.offset[joint].x);
+            tokens.next_float(skeleton.offset[joint].y);
+            tokens.next_float(skeleton.offset[joint].z);
+        }
         else if (tmp == "CHANNELS") {
             // loading num of channels
-            stream >> joint->num_channels;
+            tokens.next_uint(skeleton.num_channels[joint]);
 
-            // adding to motiondata
-            motionData.num_motion_channels += joint->num_channels;
+            // the joint's channels follow the ones loaded so far
+            skeleton.channel_start[joint] = motionData.num_motion_channels;
 
-            // increasing static counter of channel index starting motion section
-            joint->channel_start = chanel_global_index;
-            chanel_global_index += joint->num_channels;
+            // adding to motiondata
+            motionData.num_motion_channels += skeleton.num_channels[joint];
 
-            // creating array for channel order specification
-            joint->channels_order = new short[joint->num_channels];
+            // channel types are stored at the joint's channel indices
+            skeleton.channels_order.resize(motionData.num_motion_channels);
         }
         else if (tmp == "JOINT") {
             // loading child joint and setting this as a parent
-            JOINT* tmp_joint = loadjoint(stream, joint);
-
-            tmp_joint->parent = joint;
-            joint->children.push_back(tmp_joint);
+            loadjoint(tokens, joint);
         }
         else if (tmp == "End") {
-            stream >> tmp >> tmp;
+            // The word "Site" and the opening brace
+            tokens.next();
+            tokens.next();
 
-            JOINT * tmp_joint = new JOINT;
+            unsigned int end_site = skeleton.add_joint(joint, "End Site", 8);
 
-            tmp_joint->parent = joint;
-            tmp_joint->num_channels = 0;
-            tmp_joint->name = "End Site";
-            joint->children.push_back(tmp_joint);
-
-            stream >> tmp;
-            if (tmp == "OFFSET")
-                stream >> tmp_joint->offset.x >> tmp_joint->offset.y >> tmp_joint->offset.z;
+            if (tokens.next() == "OFFSET") {
+                tokens.next_float(skeleton.offset[end_site].x);
+                tokens.next_float(skeleton.offset[end_site].y);
+                tokens.next_float(skeleton.offset[end_site].z);
+            }
 
-            stream >> tmp;
+            // The closing brace
+            tokens.next();
         }
         else if(tmp == "}")
             return joint;
@@ -213,147 +484,1088 @@ JOINT * BVH::loadjoint(istream& stream, JOINT* parent)
 	return joint;
 }
 
-void BVH::loadmotion(istream& stream)
+bool BVH::project_joints()
 {
-    string tmp;
-    stringstream frame_time;
-    float x;
-    
-    int index;
+    line_channels = motionData.num_motion_channels;
+
+    if (load_options.joints.empty())
+        return true;
+
+    vector<bool> keep(skeleton.num_joints, false);
+
+    for (auto & wanted: load_options.joints) {
+        unsigned int joint = 0;
+        while (joint < skeleton.num_joints && wanted != skeleton.name[joint])
+            joint++;
+
+        if (joint == skeleton.num_joints) {
+            load_error = "no joint named " + wanted;
+            return false;
+        }
+
+        // the joint and its ancestors, up to one that is already kept
+        for (int i = joint; i >= 0 && !keep[i]; i = skeleton.parent[i])
+            keep[i] = true;
+    }
+
+    // Kept joints and their channels move down in place, the depth first
+    // order stays and a joint's new index is never above its old one
+    vector<int> new_index(skeleton.num_joints, -1);
+    unsigned int num_joints = 0;
+    unsigned int num_columns = 0;
+
+    channel_columns.assign(line_channels, -1);
+
+    for (unsigned int joint = 0; joint < skeleton.num_joints; joint++) {
+        if (!keep[joint])
+            continue;
+
+        unsigned int channel_start = skeleton.channel_start[joint];
+        unsigned int num_channels = skeleton.num_channels[joint];
+        int parent = skeleton.parent[joint];
+
+        for (unsigned int i = 0; i < num_channels; i++) {
+            channel_columns[channel_start + i] = num_columns + i;
+            skeleton.channels_order[num_columns + i] = skeleton.channels_order[channel_start + i];
+        }
+
+        new_index[joint] = num_joints;
+        skeleton.parent[num_joints] = parent >= 0 ? new_index[parent] : -1;
+        skeleton.offset[num_joints] = skeleton.offset[joint];
+        skeleton.num_channels[num_joints] = num_channels;
+        skeleton.channel_start[num_joints] = num_columns;
+        skeleton.name[num_joints] = skeleton.name[joint];
+
+        num_joints++;
+        num_columns += num_channels;
+    }
+
+    skeleton.num_joints = num_joints;
+    skeleton.parent.resize(num_joints);
+    skeleton.offset.resize(num_joints);
+    skeleton.num_channels.resize(num_joints);
+    skeleton.channel_start.resize(num_joints);
+    skeleton.channels_order.resize(num_columns);
+    skeleton.name.resize(num_joints);
+    skeleton.bind.resize(num_joints);
+    skeleton.kernel.resize(num_joints);
+#ifdef BVH_SIMD_KINEMATICS
+    skeleton.kernel_x4.resize(num_joints);
+#endif
+
+    motionData.num_motion_channels = num_columns;
+    return true;
+}
+
+void BVH::build_joints()
+{
+    joints.allocate(arena, skeleton.num_joints);
+
+    // children arrays are sized up front, they are filled in order below
+    for (unsigned int i = 1; i < skeleton.num_joints; i++)
+        joints[skeleton.parent[i]].children.count++;
+
+    for (auto & joint: joints) {
+        joint.children.data = arena.allocate_array<JOINT *>(joint.children.count);
+        joint.children.count = 0;
+    }
+
+    for (unsigned int i = 0; i < skeleton.num_joints; i++) {
+        JOINT & joint = joints[i];
+
+        joint.index = i;
+        joint.name = skeleton.name[i];
+        joint.offset.x = skeleton.offset[i].x;
+        joint.offset.y = skeleton.offset[i].y;
+        joint.offset.z = skeleton.offset[i].z;
+        joint.num_channels = skeleton.num_channels[i];
+        joint.channel_start = skeleton.channel_start[i];
 
-    while (stream.good()) {
-        stream >> tmp;
+        if (joint.num_channels)
+            joint.channels_order = &skeleton.channels_order[joint.channel_start];
 
-        if (trim(tmp) == "Frames:")
-            stream >> motionData.num_frames;
-        else if(trim(tmp) == "Frame") {
+        // parents come first, so theirs is already built
+        if (skeleton.parent[i] >= 0) {
+            joint.parent = &joints[skeleton.parent[i]];
+            joint.parent->children.data[joint.parent->children.count++] = &joint;
+        }
+    }
+
+    rootJoint = skeleton.num_joints ? &joints[0] : NULL;
+}
+
+void BVH::loadmotion(Tokenizer& tokens)
+{
+    while (tokens.good()) {
+        TOKEN tmp = tokens.next();
+
+        if (tmp == "Frames:")
+            tokens.next_uint(text_frames);
+        else if(tmp == "Frame") {
             // The word "Time:"
-            stream >> tmp;
+            tokens.next();
 
             // Actual frame time (fp)
-            stream >> tmp;
-            frame_time << tmp;
-            frame_time >> motionData.frame_time;
-
-            // creating motion data array
-            motionData.data = new float[motionData.num_frames * motionData.num_motion_channels];
-
-            // foreach frame read and store floats
-            for (unsigned int frame = 0; frame < motionData.num_frames; frame++) {
-                for (unsigned int channel = 0; channel < motionData.num_motion_channels; channel++) {
-                    // reading float
-                    stringstream ss;
-                    stream >> tmp;
-                    ss << tmp;
-                    ss >> x;
-
-                    // calculating index for storage
-                    index = frame * motionData.num_motion_channels + channel;
-                    motionData.data[index] = x;
+            tokens.next_float(motionData.frame_time);
+
+            // the frames loaded are every line_step-th frame line from
+            // first_line, each lasting line_step frame times
+            first_line = std::min(load_options.first_frame, text_frames);
+            line_step = std::max(load_options.frame_stride, 1u);
+
+            unsigned int last_line = std::min(load_options.last_frame, text_frames);
+            motionData.num_frames = last_line > first_line ? (last_line - first_line - 1) / line_step + 1 : 0;
+            motionData.frame_time *= line_step;
+
+            // the header is all an info load reads, a tailed file's frame
+            // lines are read as they are appended
+            if (load_options.header_only || load_options.tail) {
+                motion_lines = tokens.position();
+                tokens.skip_to_end();
+                return;
+            }
+
+            // creating motion data array, aligned for SIMD loads like a mapped .bvhb
+            motionData.data = static_cast<float *>(arena.allocate((size_t) motionData.num_frames *
+                motionData.num_motion_channels * sizeof(float), BVHB_ALIGNMENT));
+
+            // a progressive or indexed load parses the frame lines later
+            if (load_options.progressive || load_options.frame_index) {
+                motion_lines = tokens.position();
+                tokens.skip_to_end();
+                return;
+            }
+
+            // the frame lines are checked the same way on every path; large
+            // blocks are split at line boundaries and parsed on all workers
+            size_t block_size = tokens.end() - tokens.position();
+            unsigned int threads = block_size >= parallel_motion_bytes ? worker_count(load_options.threads) : 1;
+
+            loadmotion_lines(tokens.position(), tokens.end(), threads);
+            tokens.skip_to_end();
+            return;
+        }
+    }
+}
+
+static inline bool is_blank(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+// Returns the end of the line starting at p (the '\n' or end)
+static inline const char * line_end(const char * p, const char * end)
+{
+    const char * newline = static_cast<const char *>(memchr(p, '\n', end - p));
+    return newline ? newline : end;
+}
+
+// Whether the line [p, eol) holds anything but whitespace
+static inline bool has_values(const char * p, const char * eol)
+{
+    while (p < eol && is_blank(*p))
+        p++;
+    return p < eol;
+}
+
+// Counts the non-empty lines in [begin, end)
+static unsigned int count_frame_lines(const char * begin, const char * end)
+{
+    unsigned int lines = 0;
+
+    for (const char * p = begin; p < end; ) {
+        const char * eol = line_end(p, end);
+        if (has_values(p, eol))
+            lines++;
+        p = eol + 1;
+    }
+
+    return lines;
+}
+
+// Parses the frame lines of [begin, end), the first one being frame line
+// "line", into the frames of "lines" from "frame" on, stopping after
+// "last_frame". The lines between loaded frames are only counted. Returns the
+// first frame whose line does not hold exactly lines.channels values, or
+// last_frame if all were good.
+static unsigned int parse_frame_lines(const char * begin, const char * end, const char * limit,
+                                      const FRAME_LINES & lines, unsigned int line,
+                                      unsigned int frame, unsigned int last_frame)
+{
+    const int * columns = lines.columns;
+
+    for (const char * p = begin; p < end; ) {
+        const char * eol = line_end(p, end);
+
+        if (has_values(p, eol)) {
+            unsigned int step = line - lines.first_line;
+
+            if (line++ < lines.first_line || step % lines.line_step != 0 || step / lines.line_step < frame) {
+                p = eol + 1;
+                continue;
+            }
+
+            unsigned int current = step / lines.line_step;
+            if (current >= last_frame)
+                break;
 
+            float * value = lines.data + (size_t) current * lines.stride;
+            unsigned int count = 0;
+
+            while (true) {
+                while (p < eol && is_blank(*p))
+                    p++;
+                if (p == eol)
+                    break;
+
+                const char * token = p;
+                while (p < eol && !is_blank(*p))
+                    p++;
+
+                if (count == lines.channels)
+                    return current;
+
+                if (!columns)
+                    value[count] = parse_float(token, p, limit);
+                else if (columns[count] >= 0)
+                    value[columns[count]] = parse_float(token, p, limit);
+
+                count++;
+            }
+
+            if (count != lines.channels)
+                return current;
+        }
+
+        p = eol + 1;
+    }
+
+    return last_frame;
+}
+
+FRAME_LINES BVH::frame_lines()
+{
+    FRAME_LINES lines;
+    lines.data = motionData.data;
+    lines.stride = motionData.num_motion_channels;
+    lines.channels = line_channels;
+    lines.columns = channel_columns.empty() ? NULL : channel_columns.data();
+    lines.first_line = first_line;
+    lines.line_step = line_step;
+    return lines;
+}
+
+bool BVH::loadmotion_lines(const char * begin, const char * end, unsigned int threads)
+{
+    unsigned int num_chunks = threads > 1 ? threads * 4 : 1;
+
+    // chunks start right after a newline so no frame line is split
+    vector<const char *> chunk_start(num_chunks + 1);
+    chunk_start[0] = begin;
+    chunk_start[num_chunks] = end;
+
+    for (unsigned int i = 1; i < num_chunks; i++) {
+        const char * p = begin + (end - begin) / num_chunks * i;
+        p = std::max(p, chunk_start[i - 1]);
+        chunk_start[i] = std::min(line_end(p, end) + 1, end);
+    }
+
+    // Pass 1: count the frame lines in every chunk to find where each one starts
+    vector<unsigned int> chunk_line(num_chunks + 1, 0);
+
+    parallel_for(num_chunks, threads, [&](unsigned int i) {
+        chunk_line[i + 1] = count_frame_lines(chunk_start[i], chunk_start[i + 1]);
+    });
+
+    for (unsigned int i = 0; i < num_chunks; i++)
+        chunk_line[i + 1] += chunk_line[i];
+
+    FRAME_LINES lines = frame_lines();
+    unsigned int needed_lines = motionData.num_frames ? lines.line(motionData.num_frames - 1) + 1 : 0;
+
+    if (chunk_line[num_chunks] < needed_lines) {
+        stringstream message;
+        message << "found " << chunk_line[num_chunks] << " frame lines, expected " << needed_lines;
+        load_error = message.str();
+        return false;
+    }
+
+    // Pass 2: parse every chunk straight into its frames' slots
+    std::atomic<unsigned int> bad_frame(motionData.num_frames.load());
+
+    parallel_for(num_chunks, threads, [&](unsigned int i) {
+        unsigned int first = lines.frames_before(chunk_line[i]);
+        unsigned int last = std::min<unsigned int>(lines.frames_before(chunk_line[i + 1]), motionData.num_frames);
+
+        if (first >= last)
+            return;
+
+        unsigned int bad = parse_frame_lines(chunk_start[i], chunk_start[i + 1], end,
+                                             lines, chunk_line[i], first, last);
+
+        if (bad == last)
+            return;
+
+        // keep the lowest bad frame
+        unsigned int current = bad_frame;
+        while (bad < current && !bad_frame.compare_exchange_weak(current, bad))
+            ;
+    });
+
+    if (bad_frame < motionData.num_frames) {
+        stringstream message;
+        message << "frame " << lines.line(bad_frame) << " does not have "
+                << line_channels << " channel values";
+        load_error = message.str();
+        return false;
+    }
+
+    return true;
+}
+
+bool BVH::open_index(const char * filename)
+{
+    uint64_t size;
+    int64_t mtime;
+    if (!file_stamp(filename, size, mtime)) {
+        load_error = string("cannot stat ") + filename;
+        return false;
+    }
+
+    string index_name = index_filename(filename);
+
+    if (!load_options.use_cache || !load_index(index_name, sourceFile.size(), mtime)) {
+        if (!build_index())
+            return false;
+
+        if (load_options.use_cache)
+            save_index(index_name, sourceFile.size(), mtime);
+    }
+
+    parsed_frames.assign(motionData.num_frames, false);
+    bad_frames.assign(motionData.num_frames, false);
+    return true;
+}
+
+bool BVH::build_index()
+{
+    uint64_t * offsets = arena.allocate_array<uint64_t>(text_frames);
+    const char * end = sourceFile.end();
+    unsigned int frame = 0;
+
+    // every frame line is indexed whichever are loaded, blank lines are
+    // skipped the way the parser skips them
+    for (const char * p = motion_lines; p < end && frame < text_frames; ) {
+        const char * eol = line_end(p, end);
+
+        if (has_values(p, eol))
+            offsets[frame++] = p - sourceFile.begin();
+
+        p = eol + 1;
+    }
+
+    if (frame < text_frames) {
+        stringstream message;
+        message << "found " << frame << " frame lines, expected " << text_frames;
+        load_error = message.str();
+        return false;
+    }
+
+    frame_offsets = offsets;
+    return true;
+}
+
+bool BVH::load_frames(unsigned int first, unsigned int last)
+{
+    if (!frame_offsets)
+        return true;
+
+    const unsigned int channels = motionData.num_motion_channels;
+    const char * begin = sourceFile.begin();
+    const char * end = sourceFile.end();
+    FRAME_LINES lines = frame_lines();
+    bool good = true;
+
+    last = std::min<unsigned int>(last, motionData.num_frames);
+
+    std::lock_guard<std::mutex> guard(motion_lock);
+
+    for (unsigned int frame = first; frame < last; ) {
+        if (parsed_frames[frame]) {
+            good = good && !bad_frames[frame];
+            frame++;
+            continue;
+        }
+
+        // the run of unparsed frames is one range of lines
+        unsigned int run_end = frame + 1;
+        while (run_end < last && !parsed_frames[run_end])
+            run_end++;
+
+        unsigned int line = lines.line(frame);
+        unsigned int end_line = lines.line(run_end - 1) + 1;
+        const char * text_end = end_line < text_frames ? begin + frame_offsets[end_line] : end;
+        unsigned int bad = parse_frame_lines(begin + frame_offsets[line], text_end, end,
+                                             lines, line, frame, run_end);
+
+        // a bad line reads as zeros, like the missing values of a truncated file
+        if (bad < run_end) {
+            std::fill(motionData.data + (size_t) bad * channels, motionData.data + (size_t) (bad + 1) * channels, 0.0f);
+            bad_frames[bad] = true;
+            run_end = bad + 1;
+            good = false;
+        }
+
+        for (; frame < run_end; frame++)
+            parsed_frames[frame] = true;
+    }
+
+    return good;
+}
+
+void BVH::start_progressive(const string & cache_name, int64_t source_mtime)
+{
+    // whatever frame_pose() uses is set up before the first frame is published
+    if (load_options.lazy_kinematics) {
+        frame_cache.reset(load_options.frame_cache_bytes, skeleton.num_joints);
+        prefetch_thread = std::thread(&BVH::prefetch, this);
+    }
+    else {
+        POSITION_FORMAT format = load_options.position_format;
+        poses.allocate(format == POSITIONS_INT16 ? POSITIONS_FLOAT : format, load_options.pose_layout,
+                       skeleton.num_joints, motionData.num_frames);
+    }
+
+    loading_motion = true;
+    load_thread = std::thread(&BVH::load_progressive, this, cache_name, source_mtime);
+}
+
+void BVH::publish(unsigned int frames)
+{
+    {
+        std::lock_guard<std::mutex> guard(ready_lock);
+        ready_frames.store(frames, std::memory_order_release);
+    }
+    ready_signal.notify_all();
+}
+
+void BVH::load_progressive(string cache_name, int64_t source_mtime)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    const unsigned int num_frames = motionData.num_frames;
+    const unsigned int threads = worker_count(load_options.threads);
+    const bool lazy = load_options.lazy_kinematics;
+    const char * end = sourceFile.end();
+    const char * cursor = motion_lines;     // NULL when the motion came from the sidecar
+    unsigned int cursor_line = 0;           // frame lines before cursor
+    FRAME_LINES lines = frame_lines();
+
+    // int16 positions are only valid once quantized over the whole clip's bounds
+    const bool quantize = !lazy && load_options.position_format == POSITIONS_INT16;
+
+    unsigned int batch_frames = progressive_first_frames;
+    unsigned int done = 0;
+    string error;
+
+    // Every round takes one batch of frames per worker, the frames are
+    // published once the whole round is in
+    while (done < num_frames && !load_stop) {
+        vector<unsigned int> batch_frame(1, done);      // first frame of each batch, then the round's end
+        vector<const char *> batch_text(1, cursor);     // their frame lines, found here so batches parse independently
+        vector<unsigned int> batch_line(1, cursor_line);
+
+        for (unsigned int i = 0; i < threads && batch_frame.back() < num_frames; i++) {
+            unsigned int last = std::min(batch_frame.back() + batch_frames, num_frames);
+
+            if (cursor) {
+                unsigned int end_line = lines.line(last - 1) + 1;
+
+                while (cursor < end && cursor_line < end_line) {
+                    const char * eol = line_end(cursor, end);
+                    if (has_values(cursor, eol))
+                        cursor_line++;
+                    cursor = std::min(eol + 1, end);
                 }
+
+                last = lines.frames_before(cursor_line);
             }
+
+            if (last == batch_frame.back())
+                break;
+
+            batch_frame.push_back(last);
+            batch_text.push_back(cursor);
+            batch_line.push_back(cursor_line);
+        }
+
+        unsigned int num_batches = batch_frame.size() - 1;
+
+        if (!num_batches) {
+            stringstream message;
+            message << "found " << cursor_line << " frame lines, expected " << lines.line(num_frames - 1) + 1;
+            error = message.str();
+            break;
+        }
+
+        vector<unsigned int> batch_good(num_batches);
+        vector<BOUNDS> batch_bounds(num_batches);
+        vector<float> batch_error(num_batches, 0.0f);
+
+        parallel_for(num_batches, threads, [&](unsigned int i) {
+            unsigned int first = batch_frame[i];
+            unsigned int last = batch_frame[i + 1];
+
+            if (batch_text[0])
+                last = parse_frame_lines(batch_text[i], batch_text[i + 1], end,
+                                         lines, batch_line[i], first, last);
+            batch_good[i] = last;
+
+            if (!lazy) {
+                preprocess_frames(first, last, batch_bounds[i], batch_error[i]);
+            }
+            else if (first < last) {
+                // a lazily evaluated clip is bounded by the first frame of every batch
+                vector<glm::vec3> positions(skeleton.num_joints);
+                evaluate_pose(first, positions.data());
+
+                for (auto & vertex: positions)
+                    batch_bounds[i].add(vertex);
+            }
+        });
+
+        {
+            std::lock_guard<std::mutex> guard(bounds_lock);
+
+            for (unsigned int i = 0; i < num_batches && error.empty(); i++) {
+                bounds.add(batch_bounds[i]);
+                position_error = std::max(position_error, batch_error[i]);
+                done = batch_good[i];
+
+                if (batch_good[i] < batch_frame[i + 1]) {
+                    stringstream message;
+                    message << "frame " << lines.line(batch_good[i]) << " does not have " << line_channels << " channel values";
+                    error = message.str();
+                }
+            }
+        }
+
+        if (!quantize)
+            publish(done);
+
+        if (!error.empty())
+            break;
+
+        batch_frames = std::min(batch_frames * 2, preprocess_task_frames);
+    }
+
+    if (quantize && error.empty() && !load_stop) {
+        position_error = poses.quantize(bounds.minimum, bounds.maximum, load_options.threads);
+        publish(done);
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (!lazy && seconds > 0)
+        preprocess_rate = (double) done * skeleton.num_joints / seconds;
+
+    if (motion_lines && !cache_name.empty() && error.empty() && !load_stop)
+        save_cache(cache_name, hash_bytes(sourceFile.begin(), sourceFile.size()), sourceFile.size(), source_mtime);
+
+    sourceFile.close();
+
+    {
+        std::lock_guard<std::mutex> guard(ready_lock);
+        load_error = error;
+        loading_motion.store(false, std::memory_order_release);
+    }
+    ready_signal.notify_all();
+}
+
+void BVH::start_tail(const char * filename)
+{
+    uint64_t offset = motion_lines - sourceFile.begin();
+    sourceFile.close();
+
+    if (!tail_motion.reserve(tail_reserve_bytes)) {
+        load_error = "cannot reserve the motion memory for tailing";
+        return;
+    }
+
+    // the text is read through a descriptor, a mapping does not grow with the file
+    int file = open(filename, O_RDONLY);
+    if (file < 0) {
+        load_error = string("cannot open ") + filename;
+        return;
+    }
+
+    // without inotify the file is polled
+    int watch = -1;
+#ifdef __linux__
+    watch = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (watch >= 0 && inotify_add_watch(watch, filename, IN_MODIFY) < 0) {
+        close(watch);
+        watch = -1;
+    }
+#endif
+
+    motionData.data = reinterpret_cast<float *>(tail_motion.data());
+    motionData.num_frames = 0;
+
+    frame_cache.reset(load_options.frame_cache_bytes, skeleton.num_joints);
+    prefetch_thread = std::thread(&BVH::prefetch, this);
+
+    loading_motion = true;
+    load_thread = std::thread(&BVH::load_tail, this, string(filename), file, watch, offset);
+}
+
+// Returns once the watched file was written to, or after tail_poll_ms
+static void wait_for_change(int watch)
+{
+#ifdef __linux__
+    if (watch >= 0) {
+        struct pollfd request;
+        request.fd = watch;
+        request.events = POLLIN;
+        request.revents = 0;
+
+        // which event it was does not matter, the file is read again either way
+        if (poll(&request, 1, tail_poll_ms) > 0) {
+            char events[4096];
+            while (read(watch, events, sizeof(events)) > 0)
+                ;
         }
+        return;
     }
+#else
+    (void) watch;
+#endif
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(tail_poll_ms));
+}
+
+void BVH::load_tail(string filename, int file, int watch, uint64_t offset)
+{
+    const size_t frame_bytes = std::max<size_t>(motionData.num_motion_channels * sizeof(float), 1);
+    const size_t capacity = tail_motion.capacity() / frame_bytes;
+    FRAME_LINES lines = frame_lines();
+
+    vector<char> text;      // read but not parsed yet, at most the end of an unfinished line
+    unsigned int frames = 0;
+    string error;
+
+    while (!load_stop && error.empty()) {
+        size_t kept = text.size();
+        text.resize(kept + tail_read_bytes);
+
+        ssize_t count = pread(file, text.data() + kept, tail_read_bytes, offset);
+        text.resize(kept + std::max<ssize_t>(count, 0));
+
+        if (count < 0) {
+            error = "cannot read " + filename;
+            break;
+        }
+
+        if (count == 0) {
+            struct stat info;
+            if (fstat(file, &info) == 0 && (uint64_t) info.st_size < offset) {
+                error = filename + " was truncated";
+                break;
+            }
+
+            wait_for_change(watch);
+            continue;
+        }
+
+        offset += count;
+
+        // a line still being written is parsed once its newline is in
+        const char * begin = text.data();
+        const char * end = begin + text.size();
+        const char * complete = end;
+
+        while (complete > begin && complete[-1] != '\n')
+            complete--;
+
+        if (complete == begin)
+            continue;
+
+        unsigned int new_frames = count_frame_lines(begin, complete);
+
+        if (frames + new_frames > capacity) {
+            stringstream message;
+            message << "tailing holds at most " << capacity << " frames";
+            error = message.str();
+            break;
+        }
+
+        unsigned int last = frames + new_frames;
+        unsigned int bad = parse_frame_lines(begin, complete, end, lines, frames, frames, last);
+
+        if (bad < last) {
+            stringstream message;
+            message << "frame " << bad << " does not have " << line_channels << " channel values";
+            error = message.str();
+            last = bad;
+        }
+
+        // only the new frames are evaluated, the newest are the ones shown
+        BOUNDS new_bounds;
+
+        for (unsigned int frame = frames; frame < last; frame++) {
+            std::shared_ptr<vector<glm::vec3> > pose = std::make_shared<vector<glm::vec3> >(skeleton.num_joints);
+            evaluate_pose(frame, pose->data());
+            frame_cache.insert(frame, pose);
+
+            for (auto & vertex: *pose)
+                new_bounds.add(vertex);
+        }
+
+        {
+            std::lock_guard<std::mutex> guard(bounds_lock);
+            bounds.add(new_bounds);
+        }
+
+        frames = last;
+        motionData.num_frames = frames;
+        publish(frames);
+
+        text.erase(text.begin(), text.begin() + (complete - begin));
+    }
+
+    close(file);
+    if (watch >= 0)
+        close(watch);
+
+    {
+        std::lock_guard<std::mutex> guard(ready_lock);
+        load_error = error;
+        loading_motion.store(false, std::memory_order_release);
+    }
+    ready_signal.notify_all();
 }
 
 void BVH::preprocess_motion()
 {
-    // Setup the joints storage for the animation
-    rootJoint->ini_animation_frames(motionData.num_frames);
+    if (load_options.lazy_kinematics) {
+        preprocess_lazy();
+        return;
+    }
 
-    // Step 1: Loop over frames
-    for (unsigned int frame_number = 0; frame_number < motionData.num_frames; frame_number++) {
-        // Step 2: Start the children's decent...
-        preprocess_joint_frame(rootJoint, frame_number);
-        motionData.next_frame();
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    // Setup the storage for the animation, int16 positions need the bounds
+    // so they are quantized from floats once every frame is done
+    POSITION_FORMAT format = load_options.position_format;
+    poses.allocate(format == POSITIONS_INT16 ? POSITIONS_FLOAT : format, load_options.pose_layout,
+                   skeleton.num_joints, motionData.num_frames);
+
+    // Frames are independent, so ranges of them are evaluated on all workers,
+    // each with its own bounds and error that are merged once every range is done
+    unsigned int num_tasks = (motionData.num_frames + preprocess_task_frames - 1) / preprocess_task_frames;
+    vector<BOUNDS> task_bounds(num_tasks);
+    vector<float> task_error(num_tasks, 0.0f);
+
+    parallel_for(num_tasks, load_options.threads, [&](unsigned int task) {
+        unsigned int first = task * preprocess_task_frames;
+        unsigned int last = std::min<unsigned int>(first + preprocess_task_frames, motionData.num_frames);
+
+        preprocess_frames(first, last, task_bounds[task], task_error[task]);
+    });
+
+    bounds = BOUNDS();
+    for (auto & frame_bounds: task_bounds)
+        bounds.add(frame_bounds);
+
+    position_error = 0;
+    for (auto error: task_error)
+        position_error = std::max(position_error, error);
+
+    if (format == POSITIONS_INT16)
+        position_error = poses.quantize(bounds.minimum, bounds.maximum, load_options.threads);
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (seconds > 0)
+        preprocess_rate = (double) motionData.num_frames * skeleton.num_joints / seconds;
+}
+
+void BVH::preprocess_changed(const BVH * previous)
+{
+    frames_changed = motionData.num_frames;
+
+    // positions carry over from a clip of the same skeleton and frames, fully
+    // parsed and evaluated the same way; compact formats are evaluated again,
+    // as their error and int16 grid depend on the whole clip
+    bool reusable = previous && previous->motionData.data && !previous->frame_offsets &&
+                    same_hierarchy(*previous) && previous->motionData.num_frames == motionData.num_frames &&
+                    previous->load_options.lazy_kinematics == load_options.lazy_kinematics &&
+                    previous->load_options.trig_precision == load_options.trig_precision &&
+                    previous->load_options.simd_kinematics == load_options.simd_kinematics &&
+                    (load_options.lazy_kinematics ||
+                     (load_options.position_format == POSITIONS_FLOAT && previous->poses.format == POSITIONS_FLOAT &&
+                      previous->poses.layout == load_options.pose_layout));
+
+    if (!reusable) {
+        preprocess_motion();
+        return;
     }
+
+    const unsigned int num_frames = motionData.num_frames;
+    const size_t channels = motionData.num_motion_channels;
+    const unsigned int num_tasks = (num_frames + preprocess_task_frames - 1) / preprocess_task_frames;
+
+    // Frames whose channel values differ
+    vector<unsigned char> changed(num_frames);
+    vector<unsigned int> task_changed(num_tasks, 0);
+
+    parallel_for(num_tasks, load_options.threads, [&](unsigned int task) {
+        unsigned int first = task * preprocess_task_frames;
+        unsigned int last = std::min(first + preprocess_task_frames, num_frames);
+
+        for (unsigned int frame = first; frame < last; frame++) {
+            changed[frame] = memcmp(motionData.data + frame * channels, previous->motionData.data + frame * channels,
+                                    channels * sizeof(float)) != 0;
+            task_changed[task] += changed[frame];
+        }
+    });
+
+    frames_changed = 0;
+    for (auto count: task_changed)
+        frames_changed += count;
+
+    if (load_options.lazy_kinematics) {
+        preprocess_lazy(previous, changed.data());
+        return;
+    }
+
+    // the changed frames are evaluated over a copy of the previous positions,
+    // then every task bounds its frames from the positions
+    poses.copy_from(previous->poses);
+
+    vector<BOUNDS> task_bounds(num_tasks);
+
+    parallel_for(num_tasks, load_options.threads, [&](unsigned int task) {
+        unsigned int first = task * preprocess_task_frames;
+        unsigned int last = std::min(first + preprocess_task_frames, num_frames);
+
+        for (unsigned int frame = first; frame < last && task_changed[task]; ) {
+            if (!changed[frame]) {
+                frame++;
+                continue;
+            }
+
+            unsigned int run_end = frame + 1;
+            while (run_end < last && changed[run_end])
+                run_end++;
+
+            BOUNDS run_bounds;
+            float run_error = 0;
+            preprocess_frames(frame, run_end, run_bounds, run_error);
+            frame = run_end;
+        }
+
+        for (unsigned int frame = first; frame < last; frame++)
+            for (unsigned int joint = 0; joint < skeleton.num_joints; joint++)
+                task_bounds[task].add(poses.get(joint, frame));
+    });
+
+    bounds = BOUNDS();
+    for (auto & frame_bounds: task_bounds)
+        bounds.add(frame_bounds);
+
+    position_error = 0;
 }
 
-void BVH::compute_min_max(glm::vec4 & vertex)
+void BVH::preprocess_lazy(const BVH * previous, const unsigned char * changed)
 {
-    static int min_max_flag = 0;
+    frame_cache.reset(load_options.frame_cache_bytes, skeleton.num_joints);
+
+    // the poses of unchanged frames stay valid
+    if (previous)
+        frame_cache.insert_from(previous->frame_cache, [changed](unsigned int frame) { return !changed[frame]; });
 
-    if (!min_max_flag) {
-        min_animation = new glm::vec3(vertex);
-        max_animation = new glm::vec3(vertex);
+    // evenly spaced frames stand in for the whole clip, those that did not
+    // change keep their bounds (a progressive load sampled none)
+    unsigned int samples = std::min<unsigned int>(motionData.num_frames, lazy_bounds_samples);
+    bool resample = !previous || previous->sample_bounds.size() != samples;
+    sample_bounds.assign(samples, BOUNDS());
+
+    parallel_for(samples, load_options.threads, [&](unsigned int sample) {
+        unsigned int frame = (unsigned int) ((uint64_t) sample * motionData.num_frames / samples);
+
+        if (!resample && !changed[frame]) {
+            sample_bounds[sample] = previous->sample_bounds[sample];
+            return;
+        }
+
+        vector<glm::vec3> positions(skeleton.num_joints);
+
+        evaluate_pose(frame, positions.data());
+
+        for (auto & vertex: positions)
+            sample_bounds[sample].add(vertex);
+    });
+
+    bounds = BOUNDS();
+    for (auto & frame_bounds: sample_bounds)
+        bounds.add(frame_bounds);
+
+    prefetch_thread = std::thread(&BVH::prefetch, this);
+}
+
+void BVH::evaluate_pose(unsigned int frame, glm::vec3 * positions)
+{
+    const unsigned int stride = motionData.num_motion_channels;
+    const float * frame_data = motionData.data + (size_t) frame * stride;
+
+    load_frames(frame, frame + 1);
+
+    vector<float> sines(stride), cosines(stride);
+    vector<AFFINE> world(skeleton.num_joints);
+
+    sincos_degrees(frame_data, stride, sines.data(), cosines.data(), load_options.trig_precision);
+    advance_frame(frame_data, sines.data(), cosines.data(), world.data());
+
+    for (unsigned int joint = 0; joint < skeleton.num_joints; joint++)
+        positions[joint] = world[joint].translation();
+}
+
+POSE BVH::frame_pose(unsigned int frame)
+{
+    // a tailed clip has motion before its first frame arrives
+    if (!has_motion() || !frames_ready())
+        return POSE();
+
+    if (!load_options.lazy_kinematics) {
+        std::shared_ptr<vector<glm::vec3> > pose;
+        POSITION_SPAN span = poses.frame_span(frame);
+
+        if (span.contiguous() && !span.empty()) {
+            pose = std::make_shared<vector<glm::vec3> >(span.data, span.data + span.size());
+        }
+        else {
+            pose = std::make_shared<vector<glm::vec3> >(skeleton.num_joints);
+
+            for (unsigned int joint = 0; joint < skeleton.num_joints; joint++)
+                (*pose)[joint] = poses.get(joint, frame);
+        }
+
+        return pose;
+    }
+
+    POSE pose = frame_cache.find(frame);
+
+    if (!pose) {
+        std::shared_ptr<vector<glm::vec3> > evaluated = std::make_shared<vector<glm::vec3> >(skeleton.num_joints);
+        evaluate_pose(frame, evaluated->data());
+        frame_cache.insert(frame, evaluated);
+        pose = evaluated;
+    }
+
+    // playback is sequential, so the next frames are evaluated ahead
+    unsigned int next = (frame + 1) % motionData.num_frames;
+
+    if (prefetch_frame != next) {
+        {
+            std::lock_guard<std::mutex> guard(prefetch_lock);
+            prefetch_frame = next;
+            prefetch_requested = true;
+        }
+        prefetch_signal.notify_one();
     }
 
-    if (vertex.x > max_animation->x)
-        max_animation->x = vertex.x;
-    else if (vertex.x < min_animation->x)
-        min_animation->x = vertex.x;
+    return pose;
+}
+
+void BVH::prefetch()
+{
+    const size_t ahead = std::min<size_t>(prefetch_frames, std::max<size_t>(frame_cache.capacity() / 2, 1));
+
+    std::unique_lock<std::mutex> guard(prefetch_lock);
 
-    if (vertex.y > max_animation->y)
-        max_animation->y = vertex.y;
-    else if (vertex.y < min_animation->y)
-        min_animation->y = vertex.y;
+    while (true) {
+        prefetch_signal.wait(guard, [this] { return prefetch_requested || prefetch_stop; });
 
-    if (vertex.z > max_animation->z)
-        max_animation->z = vertex.z;
-    else if (vertex.z < min_animation->z)
-        min_animation->z = vertex.z;
+        if (prefetch_stop)
+            return;
 
+        unsigned int first = prefetch_frame;
+        prefetch_requested = false;
+        guard.unlock();
+
+        // a tailed clip grows, so the frames to wrap around are counted per request
+        unsigned int num_frames = motionData.num_frames;
+        size_t count = std::min<size_t>(ahead, num_frames);
+
+        // a newer request restarts from its frame, the ones cached meanwhile are skipped
+        for (size_t i = 0; i < count && !prefetch_requested && !prefetch_stop; i++) {
+            unsigned int frame = (unsigned int) ((first + i) % num_frames);
+
+            // a progressive load may not have reached it yet
+            if (frame >= frames_ready())
+                break;
+
+            if (!frame_cache.contains(frame)) {
+                std::shared_ptr<vector<glm::vec3> > pose = std::make_shared<vector<glm::vec3> >(skeleton.num_joints);
+                evaluate_pose(frame, pose->data());
+                frame_cache.insert(frame, pose);
+            }
+        }
 
-    min_max_flag++;
+        guard.lock();
+    }
 }
 
-void BVH::preprocess_joint_frame(JOINT * parent_joint, unsigned int & frame_number)
+void BVH::preprocess_frames(unsigned int first, unsigned int last, BOUNDS & frame_bounds, float & max_error)
 {
-    advance_joint_frame(parent_joint);
+    const unsigned int stride = motionData.num_motion_channels;
+
+    // sin/cos of a batch of frames, small enough to stay in cache until the
+    // kernels read them
+    vector<float> sines((size_t) trig_batch_frames * stride);
+    vector<float> cosines((size_t) trig_batch_frames * stride);
 
-    glm::vec4 vertex_data_4d = parent_joint->matrix[3];
+    for (unsigned int batch = first; batch < last; batch += trig_batch_frames) {
+        unsigned int batch_last = std::min(batch + trig_batch_frames, last);
+        const float * batch_data = motionData.data + (size_t) batch * stride;
 
-    compute_min_max(vertex_data_4d);
+        sincos_degrees(batch_data, (size_t) (batch_last - batch) * stride,
+                       sines.data(), cosines.data(), load_options.trig_precision);
 
-    parent_joint->animation_frames[frame_number] = vertex_data_4d;
+#ifdef BVH_SIMD_KINEMATICS
+        if (load_options.simd_kinematics) {
+            preprocess_frames_simd(batch, batch_last, sines.data(), cosines.data(), frame_bounds, max_error);
+            continue;
+        }
+#endif
 
-    for (auto & child: parent_joint->children)
-        preprocess_joint_frame(child, frame_number);
+        preprocess_frames(batch, batch_last, sines.data(), cosines.data(), frame_bounds, max_error);
+    }
 }
 
-void BVH::advance_joint_frame(JOINT * joint)
+void BVH::preprocess_frames(unsigned int first, unsigned int last, const float * sines, const float * cosines,
+                            BOUNDS & frame_bounds, float & max_error)
 {
-    // we'll need index of motion data's array with start of this specific joint
-    int start_index = motionData.current_frame() * motionData.num_motion_channels + joint->channel_start;
+    const unsigned int stride = motionData.num_motion_channels;
 
-    // translate indetity matrix to this joint's offset parameters
-    joint->matrix = glm::translate(glm::mat4(1.0),
-                                   glm::vec3(joint->offset.x,
-                                             joint->offset.y,
-                                             joint->offset.z));
+    // scratch world matrices private to this range
+    vector<AFFINE> world(skeleton.num_joints);
 
-    // here we transform joint's local matrix with each specified channel's values
-    // which are read from motion data
-    for (unsigned int i = 0; i < joint->num_channels; i++)
-    {
-        // channel alias
-        const short& channel = joint->channels_order[i];
-
-        // extract value from motion data
-        float value = motionData.data[start_index + i];
-        
-        if (channel & Xposition)
-            joint->matrix = glm::translate(joint->matrix, glm::vec3(value, 0, 0));
-        else if (channel & Yposition)
-            joint->matrix = glm::translate(joint->matrix, glm::vec3(0, value, 0));
-        else if (channel & Zposition)
-            joint->matrix = glm::translate(joint->matrix, glm::vec3(0, 0, value));
-        else if (channel & Xrotation)
-            joint->matrix = glm::rotate(joint->matrix, value, glm::vec3(1, 0, 0));
-        else if (channel & Yrotation)
-            joint->matrix = glm::rotate(joint->matrix, value, glm::vec3(0, 1, 0));
-        else if (channel & Zrotation)
-            joint->matrix = glm::rotate(joint->matrix, value, glm::vec3(0, 0, 1));
-    }
-
-    // then we apply parent's local transfomation matrix to this joint's LTM (local tr. mtx. :)
-    if(joint->parent != NULL)
-        joint->matrix = joint->parent->matrix * joint->matrix;
-
-    // when we have calculated parent's matrix do the same to all children
-    for(auto& child : joint->children)
-        advance_joint_frame(child);
+    // Step 1: Loop over frames
+    for (unsigned int frame_number = first; frame_number < last; frame_number++) {
+        const float * frame_data = motionData.data + (size_t) frame_number * stride;
+        size_t trig_row = (size_t) (frame_number - first) * stride;
+
+        // Step 2: One pass over the skeleton for the world matrices
+        advance_frame(frame_data, sines + trig_row, cosines + trig_row, &world[0]);
+
+        for (unsigned int joint = 0; joint < skeleton.num_joints; joint++) {
+            glm::vec3 vertex = world[joint].translation();
+
+            frame_bounds.add(vertex);
+
+            max_error = std::max(max_error, poses.set(joint, frame_number, vertex));
+        }
+    }
 }
 
 string BVH::channel_index_to_string(short & i)
@@ -384,19 +1596,19 @@ string BVH::channel_index_to_string(short & i)
     return channel_name;
 }
 
-short BVH::channel_string_to_index(string & channel_name)
+short BVH::channel_string_to_index(const TOKEN & channel_name)
 {
-    if (trim(channel_name) == "Xposition")
+    if (channel_name == "Xposition")
         return 0x01;
-    else if (trim(channel_name) == "Yposition")
+    else if (channel_name == "Yposition")
         return 0x02;
-    else if (trim(channel_name) == "Zposition")
+    else if (channel_name == "Zposition")
         return 0x04;
-    else if (trim(channel_name) == "Zrotation")
+    else if (channel_name == "Zrotation")
         return 0x10;
-    else if (trim(channel_name) == "Xrotation")
+    else if (channel_name == "Xrotation")
         return 0x20;
-    else if (trim(channel_name) == "Yrotation")
+    else if (channel_name == "Yrotation")
         return 0x40;
     else
         return 0;
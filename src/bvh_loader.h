@@ -1,14 +1,20 @@
 #pragma once
 
 #include <algorithm> 
+#include <atomic>
 #include <cassert>
 #include <cctype>
+#include <climits>
+#include <condition_variable>
+#include <cstring>
 #include <functional> 
 #include <fstream>
 #include <iostream>
 #include <locale>
+#include <mutex>
 #include <sstream>
 #include <string>
+#include <thread>
 #include <vector>
 
 
@@ -25,148 +31,514 @@ using std::vector;
 #include "glm/glm.hpp"
 #include "glm/ext.hpp"
 
+#include "bvh_arena.h"
+#include "bvh_tokenizer.h"
+#include "bvh_file.h"
+#include "bvh_cache.h"
+#include "bvh_kinematics.h"
+#include "bvh_pose.h"
+
 
 struct OFFSET
 {
     float x, y, z;
 };
 
+// Joints flattened in depth first order, so a joint's parent always comes
+// before it. Forward kinematics is a single pass over these arrays. Every
+// array and name lives in the owning BVH's arena.
+struct SKELETON
+{
+    Arena * arena;
+    unsigned int num_joints;
+    ARENA_VECTOR<int> parent;                   // index of the parent joint, -1 for the root
+    ARENA_VECTOR<glm::vec3> offset;             // constant joint offsets
+    ARENA_VECTOR<unsigned int> num_channels;    // number of channels of each joint
+    ARENA_VECTOR<unsigned int> channel_start;   // index of the joint's first channel in a frame
+    ARENA_VECTOR<short> channels_order;         // channel types for every channel of a frame
+    ARENA_VECTOR<const char *> name;            // joint names, null terminated
+    ARENA_VECTOR<AFFINE> bind;                  // offset transforms, baked by BVH::bind_skeleton
+    ARENA_VECTOR<FK_KERNEL> kernel;             // local transform builder for the joint's channel layout
+#ifdef BVH_SIMD_KINEMATICS
+    ARENA_VECTOR<FK_KERNEL_X4> kernel_x4;       // same for four frames at once
+#endif
+
+    explicit SKELETON(Arena & owner) :
+        arena(&owner),
+        parent(ArenaAllocator<int>(owner)),
+        offset(ArenaAllocator<glm::vec3>(owner)),
+        num_channels(ArenaAllocator<unsigned int>(owner)),
+        channel_start(ArenaAllocator<unsigned int>(owner)),
+        channels_order(ArenaAllocator<short>(owner)),
+        name(ArenaAllocator<const char *>(owner)),
+        bind(ArenaAllocator<AFFINE>(owner)),
+        kernel(ArenaAllocator<FK_KERNEL>(owner))
+#ifdef BVH_SIMD_KINEMATICS
+        , kernel_x4(ArenaAllocator<FK_KERNEL_X4>(owner))
+#endif
+    {
+        num_joints = 0;
+    }
+
+    // Appends a joint, returns its index
+    unsigned int add_joint(int parent_index, const char * joint_name, size_t name_length) {
+        char * copy = arena->allocate_array<char>(name_length + 1);
+        memcpy(copy, joint_name, name_length);
+        copy[name_length] = '\0';
+
+        parent.push_back(parent_index);
+        offset.push_back(glm::vec3(0.0));
+        num_channels.push_back(0);
+        channel_start.push_back(0);
+        name.push_back(copy);
+        bind.push_back(AFFINE(glm::vec3(0.0)));
+        kernel.push_back(NULL);
+#ifdef BVH_SIMD_KINEMATICS
+        kernel_x4.push_back(NULL);
+#endif
+        return num_joints++;
+    }
+
+    // Drops every joint, their memory is only reclaimed with the arena
+    void clear() {
+        num_joints = 0;
+        parent.clear();
+        offset.clear();
+        num_channels.clear();
+        channel_start.clear();
+        channels_order.clear();
+        name.clear();
+        bind.clear();
+        kernel.clear();
+#ifdef BVH_SIMD_KINEMATICS
+        kernel_x4.clear();
+#endif
+    }
+};
+
+// Tree view of one SKELETON entry, used to walk the hierarchy
 struct JOINT
 {
-    string name;               // joint name
+    const char * name;              // joint name (points into the skeleton)
     JOINT* parent;                  // joint parent
     OFFSET offset;                  // joint offset 
     unsigned int num_channels;      // number of channels 
-    short* channels_order;          // array of channel order
-    vector<JOINT*> children;        // vector of joint children 
+    short* channels_order;          // array of channel order (points into the skeleton)
+    ARENA_ARRAY<JOINT*> children;   // joint children
     unsigned int channel_start;     // the id of the channel
-    glm::mat4 matrix;               // local transofrmation matrix (premultiplied with parents'
-
-    glm::vec4 * animation_frames;
+    unsigned int index;             // position in the skeleton arrays
 
     JOINT() {
         num_channels = 0;
         channel_start = 0;
+        index = 0;
 
+        name = NULL;
         parent = NULL;
         channels_order = NULL;
     }
-    ~JOINT() {
-        for (vector<JOINT*>::iterator it = children.begin() ; it != children.end(); ++it)
-            if (*it)
-                delete *it;
-    
-        if (channels_order)
-            delete [] channels_order;
-
-        delete [] animation_frames;
-    }
-
-    void ini_animation_frames(unsigned int & num_frames) {
-        animation_frames = new glm::vec4[num_frames];
+};
 
-        for (auto & child: children)
-            child->ini_animation_frames(num_frames);
+struct LOAD_OPTIONS
+{
+    unsigned int threads;           // worker threads for loading and preprocessing, 0 = one per core, 1 = serial
+    bool use_cache;                 // load from / write to the .bvhb sidecar
+    bool simd_kinematics;           // evaluate BVH::simd_frames frames per skeleton pass, one per SSE2 lane, where available
+    TRIG_PRECISION trig_precision;  // accuracy of the precomputed rotation sin/cos, see bvh_trig.h
+    POSITION_FORMAT position_format; // how the precomputed joint positions are stored, see bvh_pose.h
+    POSE_LAYOUT pose_layout;        // whether a frame's or a joint's precomputed positions are contiguous
+    bool lazy_kinematics;           // evaluate poses on demand instead of preprocessing every frame
+    size_t frame_cache_bytes;       // memory budget of the poses kept with lazy_kinematics
+    bool progressive;               // parse and evaluate the frames on a background thread, see BVH::frames_ready
+    bool frame_index;               // parse frames on demand through a frame offset index, see BVH::load_frames
+    vector<string> joints;          // names of the joints to load along with their ancestors, empty loads all
+    unsigned int first_frame;       // first frame of the text to load
+    unsigned int last_frame;        // frame of the text to stop before, past the end loads up to the end
+    unsigned int frame_stride;      // load every frame_stride-th frame, the lines between are skipped unparsed
+    bool header_only;               // stop after the MOTION header: hierarchy, frame count and time, no motion
+    bool tail;                      // keep loading the frames appended to the file until the BVH is destroyed
+
+    LOAD_OPTIONS() {
+        threads = 0;
+        use_cache = true;
+        simd_kinematics = true;
+        trig_precision = TRIG_EXACT;
+        position_format = POSITIONS_FLOAT;
+        pose_layout = POSES_FRAME_MAJOR;
+        lazy_kinematics = false;
+        frame_cache_bytes = 64 << 20;
+        progressive = false;
+        frame_index = false;
+        first_frame = 0;
+        last_frame = UINT_MAX;
+        frame_stride = 1;
+        header_only = false;
+        tail = false;
     }
 };
 
 struct MOTION
 {
-    unsigned int num_frames;              // number of frames
+    std::atomic<unsigned int> num_frames; // number of frames, grows while a tailed file is appended to
     unsigned int num_motion_channels; // number of motion channels 
-    float* data;                   // motion float data array
+    float* data;                   // motion float data array, in the arena or a mapped .bvhb file
     unsigned* joint_channel_offsets;      // number of channels from beggining of hierarchy for i-th joint
     float frame_time;
 
-    // Animation frames
-    unsigned int current_animation_frame;
-
     MOTION() {
         num_motion_channels = 0;
         num_frames = 0;
-        current_animation_frame = 2;
+        data = NULL;
+    }
+};
+
+// Which frame lines of the text are loaded and where their values go
+struct FRAME_LINES
+{
+    float * data;               // motion data, stride values per frame
+    unsigned int stride;
+    unsigned int channels;      // values in a frame line
+    const int * columns;        // motion column of each value (-1 skips it), NULL when they are the same
+    unsigned int first_line;    // frame line of frame 0
+    unsigned int line_step;     // frame lines from one frame to the next
+
+    // Frame line of a frame, and the number of frames whose lines come before a line
+    unsigned int line(unsigned int frame) const { return first_line + frame * line_step; }
+    unsigned int frames_before(unsigned int line) const {
+        return line <= first_line ? 0 : (line - first_line + line_step - 1) / line_step;
     }
-    ~MOTION() {
-        delete [] data;
+};
+
+// Axis aligned bounds of the joint positions
+struct BOUNDS
+{
+    glm::vec3 minimum;
+    glm::vec3 maximum;
+    bool empty;
+
+    BOUNDS() { empty = true; }
+
+    void add(const glm::vec3 & vertex) {
+        if (empty) {
+            minimum = maximum = vertex;
+            empty = false;
+        }
+        else {
+            minimum = glm::min(minimum, vertex);
+            maximum = glm::max(maximum, vertex);
+        }
     }
 
-    void next_frame() { current_animation_frame = (current_animation_frame + 1) % num_frames; }
-    int current_frame() { return current_animation_frame; }
+    void add(const BOUNDS & other) {
+        if (!other.empty) {
+            add(other.minimum);
+            add(other.maximum);
+        }
+    }
 };
 
 
 class BVH {
 	public:
-		BVH(const char * filename);
+		BVH(const char * filename, const LOAD_OPTIONS & options = LOAD_OPTIONS());
 		~BVH();
 
+        // Loads every file concurrently, one BVH per file in the same order.
+        // Files that failed to load are returned with good() == false.
+        static vector<BVH *> load_many(const vector<string> & filenames, const LOAD_OPTIONS & options = LOAD_OPTIONS());
+
+        // Whether the file loaded, error() says why not. While a progressive
+        // load is running no error is reported yet.
+        bool good() const { return loading() || load_error.empty(); }
+        const string & error() const { return loading() ? no_error : load_error; }
+
+        // With LOAD_OPTIONS::progressive the constructor returns once the
+        // hierarchy is loaded and frames are published in order as they are
+        // parsed (and preprocessed, unless lazy_kinematics). Frames below
+        // frames_ready() can be used while the rest load; the bounds grow as
+        // frames come in. Without progressive every frame is ready.
+        //
+        // With LOAD_OPTIONS::tail the file is watched for appended frame
+        // lines for as long as the BVH lives, and loading() stays true.
+        // Every complete new line is parsed into motion that grows in
+        // place, animation_frames() included, and only the new frames are
+        // evaluated, into the frame cache and the bounds. The poses are
+        // evaluated lazily and the header's frame count is ignored.
+        unsigned int frames_ready() const { return ready_frames.load(std::memory_order_acquire); }
+        bool loading() const { return loading_motion.load(std::memory_order_acquire); }
+
+        // Blocks until "count" frames are ready or loading has stopped
+        void wait_frames(unsigned int count);
+
+        // Writes the clip to "output.bvh"
         void save_bvh();
 
+        // Writes the clip as BVH text on up to "threads" workers (as
+        // LOAD_OPTIONS::threads), false if the file could not be written.
+        // Every value is written with the fewest digits that read back as the
+        // same float, so loading the file gives the same motion data. The file
+        // is replaced at once when complete. Only reads the clip, so it may run
+        // on another thread while the clip is drawn or still loading; a clip
+        // still loading writes the frames ready when the call starts.
+        bool write_bvh(const char * filename, unsigned int threads = 0);
+
+        // Loads the file again with the same options into a new BVH, e.g.
+        // after it was re-exported. When the hierarchy and frame count are
+        // unchanged, the positions of this clip (float or lazily evaluated)
+        // are reused and forward kinematics only runs on the frames whose
+        // channel values differ. Check good() on the result; this clip is
+        // left as it was and is deleted by the caller. Only reads this clip,
+        // so it may run on another thread while this one is drawn.
+        BVH * reloaded();
+
+        // Whether both clips have the same joints, offsets and channel layout
+        bool same_hierarchy(const BVH & other) const;
+
+        // Frames evaluated because their values differ from the clip this
+        // one was reloaded from, every frame if none could be reused
+        unsigned int changed_frames() const { return frames_changed; }
+
         // Returns the pointer to the rootJoint
         JOINT * gethierarchy() { return rootJoint; }
 
+        // Returns the flattened skeleton
+        const SKELETON & getskeleton() { return skeleton; }
+
         // Returns the number of animation frames
         unsigned int animation_frames() { return motionData.num_frames; }
-        void advance_joint_frame(JOINT * parent_joint); // Advances animation frame by one
 
-        // Returns the min/max for the animation sequence
-        glm::vec3 animation_minimum() { return * min_animation;}
-        glm::vec3 animation_maximum() { return * max_animation;}
+        // Seconds per frame
+        float frame_time() { return motionData.frame_time; }
+
+        // Whether the motion was loaded. With LOAD_OPTIONS::header_only only
+        // the hierarchy, frame count and frame time are, the frame lines are
+        // never read and no frame is ready: frame_values() and frame_pose()
+        // return NULL, joint_position() the origin and write_bvh() false.
+        bool has_motion() { return motionData.data != NULL; }
+
+        // Number of channel values in a frame, and those of one frame
+        unsigned int motion_channels() { return motionData.num_motion_channels; }
+        const float * frame_values(unsigned int frame) {
+            if (!has_motion())
+                return NULL;
+
+            load_frames(frame, frame + 1);
+            return motionData.data + (size_t) frame * motionData.num_motion_channels;
+        }
+
+        // With LOAD_OPTIONS::frame_index only the hierarchy is parsed at load,
+        // along with one newline scan that records where every frame line
+        // starts (kept in a .bvhi sidecar while the file's size and mtime
+        // stay the same, if use_cache). Frames are parsed when first used,
+        // which also makes the clip evaluate lazily. This parses a range up
+        // front; a bad frame line reads as zeros and every call covering it
+        // returns false, whether it was parsed then or before. Without
+        // frame_index every frame is parsed at load and this does nothing.
+        bool load_frames(unsigned int first, unsigned int last);
+
+        // Computes the world matrix of every joint for one frame, in skeleton order.
+        // sines/cosines are sincos_degrees() of the frame's values.
+        void advance_frame(const float * frame_data, const float * sines, const float * cosines, AFFINE * world);
+
+#ifdef BVH_SIMD_KINEMATICS
+        // Same for up to simd_frames consecutive frames, one in each lane of world[joint]
+        void advance_frames_simd(const float * frame_data, const float * sines, const float * cosines,
+                                 unsigned int count, AFFINE_X4 * world);
+        static const unsigned int simd_frames = 4;
+#endif
+
+        // Positions of every joint in a frame (below frames_ready(), NULL while
+        // none is), in skeleton order. With LOAD_OPTIONS::lazy_kinematics the
+        // pose is evaluated on demand and kept in the frame cache, and the
+        // frames after it are evaluated ahead on a background thread.
+        POSE frame_pose(unsigned int frame);
+
+        // Position of a joint (skeleton index) in a frame
+        glm::vec3 joint_position(unsigned int joint, unsigned int frame) {
+            if (!has_motion())
+                return glm::vec3(0.0f);
+
+            if (!load_options.lazy_kinematics)
+                return poses.get(joint, frame);
+
+            POSE pose = frame_pose(frame);
+            return pose ? (*pose)[joint] : glm::vec3(0.0f);
+        }
+
+        // Precomputed positions of every joint in a frame / of a joint in every
+        // frame, viewed in place. Contiguous for the LOAD_OPTIONS::pose_layout
+        // they follow, strided for the other; empty with lazy_kinematics or a
+        // compact position_format.
+        POSITION_SPAN frame_span(unsigned int frame) const { return poses.frame_span(frame); }
+        POSITION_SPAN joint_span(unsigned int joint) const { return poses.joint_span(joint); }
+
+        // Memory held by the joint positions and the largest per axis error
+        // their LOAD_OPTIONS::position_format introduced
+        size_t position_bytes() const { return load_options.lazy_kinematics ? frame_cache.bytes() : poses.bytes(); }
+        float max_position_error() const { return position_error; }
+
+        // Joint frames per second the last preprocessing achieved
+        double preprocess_throughput() { return preprocess_rate; }
+
+        // Returns the min/max for the animation sequence, with lazy_kinematics
+        // they only cover a sample of the frames
+        glm::vec3 animation_minimum() {
+            std::lock_guard<std::mutex> guard(bounds_lock);
+            return bounds.minimum;
+        }
+        glm::vec3 animation_maximum() {
+            std::lock_guard<std::mutex> guard(bounds_lock);
+            return bounds.maximum;
+        }
+
+        // Constants for the extraction process
+        static const int Xposition = 0x01;
+        static const int Yposition = 0x02;
+        static const int Zposition = 0x04;
+        static const int Zrotation = 0x10;
+        static const int Xrotation = 0x20;
+        static const int Yrotation = 0x40;
 
 	private:
-		BVH() {};
+		BVH() : skeleton(arena) {};
+        BVH(const char * filename, const LOAD_OPTIONS & options, const BVH * previous);
 
         // Loads the heirarchy
-        void loadhierarchy(istream& stream);
-        JOINT * loadjoint(istream& stream, JOINT* parent = NULL); // load joint from string sequence
-        void loadmotion(istream& stream); // load motion from string sequence
+        void loadhierarchy(Tokenizer& tokens);
+        bool project_joints(); // Keeps only LOAD_OPTIONS::joints and their ancestors, and maps their columns
+        unsigned int loadjoint(Tokenizer& tokens, int parent = -1); // load joint from token sequence
+        void loadmotion(Tokenizer& tokens); // load motion from token sequence
+        bool loadmotion_lines(const char * begin, const char * end, unsigned int threads); // load the frame lines on threads workers
+        void start_progressive(const string & cache_name, int64_t source_mtime); // Starts loading the frames in the background
+        void load_progressive(string cache_name, int64_t source_mtime); // Body of the progressive loading thread
+        void publish(unsigned int frames); // Makes the frames below "frames" ready and wakes wait_frames()
+        void start_tail(const char * filename); // Starts loading the frames appended to the file
+        void load_tail(string filename, int file, int watch, uint64_t offset); // Body of the tail thread
+
+        // Frame index, see load_frames
+        bool open_index(const char * filename); // Loads or builds the index of the frame lines
+        bool build_index(); // Scans the frame lines for their offsets
+        bool load_index(const string & index_name, uint64_t source_size, int64_t source_mtime);
+        void save_index(const string & index_name, uint64_t source_size, int64_t source_mtime);
+
+        // Binary sidecar, see bvh_cache.h
+        // load_cache() checks the contents against source_hash, or with a NULL
+        // source_hash only the size and modification time of the source and
+        // the hierarchy
+        bool load_cache(const string & cache_name, const uint64_t * source_hash, uint64_t source_size, int64_t source_mtime);
+        void save_cache(const string & cache_name, uint64_t source_hash, uint64_t source_size, int64_t source_mtime);
+
+        void bind_skeleton(); // Bakes the offset transforms and picks the FK kernel of every joint
+        void build_joints(); // Creates the JOINT tree view over the skeleton
 
         void preprocess_motion(); // Preprocess all the animation data to load the computed vectors
-        void preprocess_joint_frame(JOINT * parent_joint, unsigned int & frame_number); // Preprocesses the paticular frame and joint
-        void compute_min_max(glm::vec4 & vertex); // Computes the min/max for given vertex and the global
+        void preprocess_changed(const BVH * previous); // Same reusing the positions of the unchanged frames of previous
+        void preprocess_lazy(const BVH * previous = NULL, const unsigned char * changed = NULL); // Sets up on demand evaluation, with bounds from sampled frames
+        void evaluate_pose(unsigned int frame, glm::vec3 * positions); // Joint positions of one frame
+        void prefetch(); // Body of the thread evaluating ahead of the requested frames
+        void preprocess_frames(unsigned int first, unsigned int last,
+                               BOUNDS & frame_bounds, float & max_error); // Preprocesses a range of frames
+        void preprocess_frames(unsigned int first, unsigned int last, const float * sines, const float * cosines,
+                               BOUNDS & frame_bounds, float & max_error); // Same given the range's sin/cos
+        void preprocess_frames_simd(unsigned int first, unsigned int last, const float * sines, const float * cosines,
+                                    BOUNDS & frame_bounds, float & max_error); // Same with SIMD transforms
         
         void dumphierarchy(ostream& stream); // Dumps the hierarchy to the stream
         void dumpjoint(JOINT * parent_joint, ostream& stream, int & tab_level); // Dump joint to the stream
-        void dumpmotion(ostream& stream); // Dumps the motion to the stream
+        bool dumpmotion(AtomicFile & file, const string & hierarchy, unsigned int threads); // Writes the hierarchy text then the motion to the file
 
         static string channel_index_to_string(short & i); // Converts the index to a string
-        static short channel_string_to_index(string & channel_name); // Converts a strign to the channel index
+        static short channel_string_to_index(const TOKEN & channel_name); // Converts a token to the channel index
 
         // Prints "tab_level" tabs to stream
         void print_tab(ostream& stream, int & tab_level);
 
+        // File and options the clip was loaded with
+        string source_name;
+        LOAD_OPTIONS load_options;
+
+        // Why loading failed, empty on success
+        string load_error;
+        static const string no_error;
+
+        // The source text, kept mapped while the frame lines load progressively
+        MappedFile sourceFile;
+        const char * motion_lines;      // first frame line, set when they are left to load_progressive
+
+        // Values in a frame line of the text, and the motion column each is
+        // stored in (-1 skips it) when only some joints are loaded
+        unsigned int line_channels;
+        vector<int> channel_columns;
+
+        // Frame lines in the text, and the ones loaded as motionData's frames
+        // with LOAD_OPTIONS::first_frame, last_frame and frame_stride
+        unsigned int text_frames;
+        unsigned int first_line;
+        unsigned int line_step;
+        FRAME_LINES frame_lines();
+
+        // Frame index: the offset of every frame line in sourceFile, in
+        // indexFile or the arena, which frames are parsed and which of
+        // those had a bad line
+        const uint64_t * frame_offsets;
+        MappedFile indexFile;
+        vector<bool> parsed_frames;
+        vector<bool> bad_frames;
+        std::mutex motion_lock;
+
+        // Motion of a tailed file, which grows without moving
+        ReservedBuffer tail_motion;
+
+        // Progressive loading
+        std::thread load_thread;
+        std::atomic<unsigned int> ready_frames;
+        std::atomic<bool> loading_motion;
+        std::atomic<bool> load_stop;
+        std::mutex ready_lock;
+        std::condition_variable ready_signal;
+
+        // Every hierarchy and motion allocation, released at once with the BVH
+        Arena arena;
+
         // Contains the joint data
+        SKELETON skeleton;
+
+        // JOINT view of every skeleton entry, rootJoint is the first
+        ARENA_ARRAY<JOINT> joints;
 		JOINT* rootJoint;
 
         // Contains the motion data
 		MOTION motionData;
 
-        // Min and max animation bounds
-        glm::vec3 * min_animation;
-        glm::vec3 * max_animation;
+        // Mapping of the .bvhb sidecar when motionData points into it
+        MappedFile cacheFile;
 
-        // Constants for the extraction process
-        static const int Xposition = 0x01;
-        static const int Yposition = 0x02;
-        static const int Zposition = 0x04;
-        static const int Zrotation = 0x10;
-        static const int Xrotation = 0x20;
-        static const int Yrotation = 0x40;
-};
+        // Precomputed joint positions
+        POSE_STORE poses;
 
-// trim from start
-static inline std::string &ltrim(std::string &s) {
-        s.erase(s.begin(), std::find_if(s.begin(), s.end(), std::not1(std::ptr_fun<int, int>(std::isspace))));
-        return s;
-}
-
-// trim from end
-static inline std::string &rtrim(std::string &s) {
-        s.erase(std::find_if(s.rbegin(), s.rend(), std::not1(std::ptr_fun<int, int>(std::isspace))).base(), s.end());
-        return s;
-}
-
-// trim from both ends
-static inline std::string &trim(std::string &s) {
-        return ltrim(rtrim(s));
-}
\ No newline at end of file
+        // Largest per axis error of the stored positions
+        float position_error;
+
+        // Lazy evaluation: the recently used poses and the thread evaluating
+        // the frames after the last requested one
+        FrameCache frame_cache;
+        std::thread prefetch_thread;
+        std::mutex prefetch_lock;
+        std::condition_variable prefetch_signal;
+        std::atomic<unsigned int> prefetch_frame;   // first frame to evaluate ahead
+        std::atomic<bool> prefetch_requested;
+        std::atomic<bool> prefetch_stop;
+
+        // Min and max animation bounds, locked while frames load progressively
+        BOUNDS bounds;
+        std::mutex bounds_lock;
+
+        // Bounds of each frame lazy_kinematics samples, reused on reload
+        vector<BOUNDS> sample_bounds;
+
+        // Joint frames per second of the last preprocess_motion()
+        double preprocess_rate;
+
+        // Frames whose positions were evaluated rather than reused
+        unsigned int frames_changed;
+};
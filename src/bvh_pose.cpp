@@ -0,0 +1,195 @@
+#include "bvh_pose.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+// Elements per quantize task
+static const size_t quantize_task_elements = 1 << 16;
+
+void POSE_STORE::reserve(size_t count, size_t element_size)
+{
+    // free the old buffer before taking the new one
+    storage.reset();
+    buffer = NULL;
+
+    if (count == 0)
+        return;
+
+    storage.reset(new char[count * element_size + alignment - 1]);
+
+    uintptr_t address = reinterpret_cast<uintptr_t>(storage.get());
+    buffer = storage.get() + ((alignment - address % alignment) % alignment);
+}
+
+void POSE_STORE::allocate(POSITION_FORMAT position_format, POSE_LAYOUT pose_layout, unsigned int joints, unsigned int frames)
+{
+    format = position_format;
+    layout = pose_layout;
+    num_joints = joints;
+    num_frames = frames;
+
+    reserve((size_t) joints * frames, format == POSITIONS_FLOAT ? sizeof(glm::vec3) : sizeof(glm::hvec3));
+}
+
+void POSE_STORE::copy_from(const POSE_STORE & other)
+{
+    format = other.format;
+    layout = other.layout;
+    num_joints = other.num_joints;
+    num_frames = other.num_frames;
+    origin = other.origin;
+    step = other.step;
+
+    size_t count = (size_t) num_joints * num_frames;
+    reserve(other.buffer ? count : 0, format == POSITIONS_FLOAT ? sizeof(glm::vec3) : sizeof(glm::hvec3));
+
+    if (buffer)
+        memcpy(buffer, other.buffer, bytes());
+}
+
+float POSE_STORE::quantize(const glm::vec3 & minimum, const glm::vec3 & maximum, unsigned int threads)
+{
+    origin = minimum;
+    step = (maximum - minimum) / 65535.0f;
+
+    // an axis without extent decodes every value to origin
+    glm::vec3 inverse_step(step.x > 0 ? 1.0f / step.x : 0.0f,
+                           step.y > 0 ? 1.0f / step.y : 0.0f,
+                           step.z > 0 ? 1.0f / step.z : 0.0f);
+
+    size_t count = (size_t) num_joints * num_frames;
+
+    // the float positions stay alive until every one is converted, an
+    // element keeps its index, so the layout carries over
+    std::unique_ptr<char[]> float_storage(storage.release());
+    const glm::vec3 * positions = reinterpret_cast<const glm::vec3 *>(buffer);
+
+    reserve(count, sizeof(glm::i16vec3));
+    format = POSITIONS_INT16;
+
+    glm::i16vec3 * quantized = reinterpret_cast<glm::i16vec3 *>(buffer);
+
+    unsigned int num_tasks = (unsigned int) ((count + quantize_task_elements - 1) / quantize_task_elements);
+    std::vector<float> task_error(num_tasks, 0.0f);
+
+    parallel_for(num_tasks, threads, [&](unsigned int task) {
+        size_t begin = task * quantize_task_elements;
+        size_t end = std::min(begin + quantize_task_elements, count);
+        float error = 0.0f;
+
+        for (size_t i = begin; i < end; i++) {
+            glm::vec3 scaled = (positions[i] - origin) * inverse_step;
+            glm::i16vec3 & packed = quantized[i];
+
+            packed.x = (short) (std::min(std::max(std::floor(scaled.x + 0.5f), 0.0f), 65535.0f) - 32768.0f);
+            packed.y = (short) (std::min(std::max(std::floor(scaled.y + 0.5f), 0.0f), 65535.0f) - 32768.0f);
+            packed.z = (short) (std::min(std::max(std::floor(scaled.z + 0.5f), 0.0f), 65535.0f) - 32768.0f);
+
+            glm::vec3 difference = glm::abs(decode(i) - positions[i]);
+            error = std::max(error, std::max(difference.x, std::max(difference.y, difference.z)));
+        }
+
+        task_error[task] = error;
+    });
+
+    return num_tasks ? *std::max_element(task_error.begin(), task_error.end()) : 0.0f;
+}
+
+size_t POSE_STORE::bytes() const
+{
+    size_t element_size = format == POSITIONS_FLOAT ? sizeof(glm::vec3) :
+                          format == POSITIONS_HALF ? sizeof(glm::hvec3) : sizeof(glm::i16vec3);
+
+    return buffer ? (size_t) num_joints * num_frames * element_size : 0;
+}
+
+POSITION_SPAN POSE_STORE::frame_span(unsigned int frame) const
+{
+    if (format != POSITIONS_FLOAT || !buffer)
+        return POSITION_SPAN();
+
+    const glm::vec3 * first = reinterpret_cast<const glm::vec3 *>(buffer) + index(0, frame);
+    return POSITION_SPAN(first, num_joints, layout == POSES_FRAME_MAJOR ? 1 : num_frames);
+}
+
+POSITION_SPAN POSE_STORE::joint_span(unsigned int joint) const
+{
+    if (format != POSITIONS_FLOAT || !buffer)
+        return POSITION_SPAN();
+
+    const glm::vec3 * first = reinterpret_cast<const glm::vec3 *>(buffer) + index(joint, 0);
+    return POSITION_SPAN(first, num_frames, layout == POSES_JOINT_MAJOR ? 1 : num_joints);
+}
+
+void FrameCache::reset(size_t budget_bytes, unsigned int num_joints)
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    entries.clear();
+    index.clear();
+
+    pose_bytes = (num_joints ? num_joints : 1) * sizeof(glm::vec3);
+    capacity_frames = std::max<size_t>(budget_bytes / pose_bytes, 1);
+}
+
+POSE FrameCache::find(unsigned int frame)
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    auto found = index.find(frame);
+    if (found == index.end())
+        return POSE();
+
+    // move to the front, the iterators stay valid
+    entries.splice(entries.begin(), entries, found->second);
+    return found->second->second;
+}
+
+bool FrameCache::contains(unsigned int frame) const
+{
+    std::lock_guard<std::mutex> guard(lock);
+    return index.count(frame) != 0;
+}
+
+void FrameCache::insert(unsigned int frame, const POSE & pose)
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    // another thread may have evaluated the same frame meanwhile
+    if (index.count(frame))
+        return;
+
+    entries.push_front(std::make_pair(frame, pose));
+    index[frame] = entries.begin();
+
+    while (entries.size() > capacity_frames) {
+        index.erase(entries.back().first);
+        entries.pop_back();
+    }
+}
+
+void FrameCache::insert_from(const FrameCache & other, const std::function<bool (unsigned int)> & keep)
+{
+    ENTRIES kept;
+
+    {
+        std::lock_guard<std::mutex> guard(other.lock);
+
+        for (auto & entry: other.entries)
+            if (keep(entry.first))
+                kept.push_back(entry);
+    }
+
+    // least recently used first, so the most recently used ends up in front
+    for (auto entry = kept.rbegin(); entry != kept.rend(); ++entry)
+        insert(entry->first, entry->second);
+}
+
+size_t FrameCache::bytes() const
+{
+    std::lock_guard<std::mutex> guard(lock);
+    return entries.size() * pose_bytes;
+}
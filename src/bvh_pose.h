@@ -0,0 +1,194 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "glm/glm.hpp"
+#include "glm/gtc/half_float.hpp"
+#include "glm/gtc/type_precision.hpp"
+
+// How the precomputed joint positions are kept in memory
+enum POSITION_FORMAT
+{
+    POSITIONS_FLOAT,    // packed float x, y, z, 12 bytes, exact
+    POSITIONS_HALF,     // glm::half x, y, z, 6 bytes, 11 significant bits
+    POSITIONS_INT16     // x, y, z quantized to 16 bits over the clip bounds, 6 bytes
+};
+
+// Which positions are next to each other in the pose buffer
+enum POSE_LAYOUT
+{
+    POSES_FRAME_MAJOR,  // the joints of a frame are contiguous, one pose per read when drawing
+    POSES_JOINT_MAJOR   // the frames of a joint are contiguous, one trajectory per read for analysis
+};
+
+// count elements "stride" elements apart, viewed in place
+template <typename T>
+struct STRIDED_SPAN
+{
+    T * data;
+    size_t count;
+    size_t stride;
+
+    STRIDED_SPAN() {
+        data = NULL;
+        count = 0;
+        stride = 1;
+    }
+
+    STRIDED_SPAN(T * first, size_t elements, size_t step) {
+        data = first;
+        count = elements;
+        stride = step;
+    }
+
+    T & operator[](size_t i) const { return data[i * stride]; }
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    bool contiguous() const { return stride == 1; }
+};
+
+typedef STRIDED_SPAN<const glm::vec3> POSITION_SPAN;
+
+// World position of every joint in every frame, in one aligned buffer laid out
+// frame-major or joint-major. Positions are written with set() while
+// preprocessing; for POSITIONS_INT16 the bounds are only known afterwards, so
+// the store is filled as POSITIONS_FLOAT and converted with quantize().
+struct POSE_STORE
+{
+    POSITION_FORMAT format;
+    POSE_LAYOUT layout;
+    unsigned int num_joints;
+    unsigned int num_frames;
+
+    // POSITIONS_INT16 decodes as origin + step * (q + 32768)
+    glm::vec3 origin;
+    glm::vec3 step;
+
+    // Start of the buffer, a multiple of this
+    static const size_t alignment = 64;
+
+    POSE_STORE() {
+        format = POSITIONS_FLOAT;
+        layout = POSES_FRAME_MAJOR;
+        num_joints = 0;
+        num_frames = 0;
+        buffer = NULL;
+    }
+
+    // Sizes the store for joints x frames positions, format is POSITIONS_FLOAT or POSITIONS_HALF
+    void allocate(POSITION_FORMAT position_format, POSE_LAYOUT pose_layout, unsigned int joints, unsigned int frames);
+
+    // Becomes a copy of another store, positions included
+    void copy_from(const POSE_STORE & other);
+
+    // Converts the POSITIONS_FLOAT positions to POSITIONS_INT16 over minimum..maximum,
+    // returns the largest per axis reconstruction error
+    float quantize(const glm::vec3 & minimum, const glm::vec3 & maximum, unsigned int threads);
+
+    // Bytes used by the positions
+    size_t bytes() const;
+
+    // Positions of every joint in a frame / of a joint in every frame. Only
+    // POSITIONS_FLOAT can be viewed in place, the spans are empty for the
+    // compact formats, whose positions decode through get().
+    POSITION_SPAN frame_span(unsigned int frame) const;
+    POSITION_SPAN joint_span(unsigned int joint) const;
+
+    // Element of a joint in a frame, the same for every format
+    size_t index(unsigned int joint, unsigned int frame) const {
+        return layout == POSES_FRAME_MAJOR ? (size_t) frame * num_joints + joint
+                                           : (size_t) joint * num_frames + frame;
+    }
+
+    // Stores a position, returns the largest per axis error of what was stored
+    float set(unsigned int joint, unsigned int frame, const glm::vec3 & position) {
+        size_t i = index(joint, frame);
+
+        if (format == POSITIONS_HALF) {
+            glm::hvec3 & packed = reinterpret_cast<glm::hvec3 *>(buffer)[i];
+            packed = glm::hvec3(glm::half(position.x), glm::half(position.y), glm::half(position.z));
+
+            glm::vec3 error = glm::abs(glm::vec3(float(packed.x), float(packed.y), float(packed.z)) - position);
+            return glm::max(error.x, glm::max(error.y, error.z));
+        }
+
+        reinterpret_cast<glm::vec3 *>(buffer)[i] = position;
+        return 0.0f;
+    }
+
+    glm::vec3 get(unsigned int joint, unsigned int frame) const { return decode(index(joint, frame)); }
+
+    private:
+        std::unique_ptr<char[]> storage;    // the allocation, buffer is aligned within it
+        char * buffer;
+
+        glm::vec3 decode(size_t i) const {
+            switch (format) {
+                case POSITIONS_HALF: {
+                    const glm::hvec3 & packed = reinterpret_cast<const glm::hvec3 *>(buffer)[i];
+                    return glm::vec3(float(packed.x), float(packed.y), float(packed.z));
+                }
+                case POSITIONS_INT16: {
+                    const glm::i16vec3 & packed = reinterpret_cast<const glm::i16vec3 *>(buffer)[i];
+                    return origin + step * (glm::vec3(packed.x, packed.y, packed.z) + 32768.0f);
+                }
+                default:
+                    return reinterpret_cast<const glm::vec3 *>(buffer)[i];
+            }
+        }
+
+        // Replaces the buffer with an uninitialized one of count elements of element_size
+        void reserve(size_t count, size_t element_size);
+};
+
+// Positions of every joint in one frame, in skeleton order
+typedef std::shared_ptr<const std::vector<glm::vec3> > POSE;
+
+// Least recently used frames' poses within a memory budget, for evaluating
+// forward kinematics on demand. Poses are shared, so one handed out stays valid
+// after it is evicted. All members are safe to call from several threads.
+class FrameCache
+{
+    public:
+        FrameCache() {
+            capacity_frames = 0;
+            pose_bytes = 0;
+        }
+
+        // Empties the cache and sizes it to hold as many poses of num_joints as fit budget_bytes (at least 1)
+        void reset(size_t budget_bytes, unsigned int num_joints);
+
+        // Returns the cached pose and marks it as most recently used, NULL if not cached
+        POSE find(unsigned int frame);
+
+        // Whether the frame is cached, without marking it as used
+        bool contains(unsigned int frame) const;
+
+        // Caches a pose, evicting the least recently used ones past the capacity
+        void insert(unsigned int frame, const POSE & pose);
+
+        // Caches the poses of another cache whose frame "keep" accepts, in the
+        // same order of use
+        void insert_from(const FrameCache & other, const std::function<bool (unsigned int)> & keep);
+
+        // Number of poses the budget holds
+        size_t capacity() const { return capacity_frames; }
+
+        // Bytes held by the cached poses
+        size_t bytes() const;
+
+    private:
+        typedef std::list<std::pair<unsigned int, POSE> > ENTRIES;
+
+        mutable std::mutex lock;
+        ENTRIES entries;                                         // most recently used first
+        std::unordered_map<unsigned int, ENTRIES::iterator> index;  // frame to its entry
+        size_t capacity_frames;
+        size_t pose_bytes;
+};
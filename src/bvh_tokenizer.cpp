@@ -0,0 +1,73 @@
+#include "bvh_tokenizer.h"
+
+#include <cstdlib>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedFile::MappedFile()
+{
+    mapping = NULL;
+    length = 0;
+}
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+bool MappedFile::open(const char * filename)
+{
+    close();
+
+    int fd = ::open(filename, O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size == 0) {
+        ::close(fd);
+        return false;
+    }
+
+    void * address = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+
+    if (address == MAP_FAILED)
+        return false;
+
+    // The file is walked front to back exactly once
+    madvise(address, info.st_size, MADV_SEQUENTIAL);
+
+    mapping = static_cast<const char *>(address);
+    length = info.st_size;
+
+    return true;
+}
+
+void MappedFile::close()
+{
+    if (mapping)
+        munmap(const_cast<char *>(mapping), length);
+
+    mapping = NULL;
+    length = 0;
+}
+
+bool Tokenizer::next_uint(unsigned int & value)
+{
+    TOKEN token = next();
+    char buffer[32];
+
+    if (token.empty() || token.length >= sizeof(buffer))
+        return false;
+
+    // tokens are not null terminated, copy to the stack before converting
+    memcpy(buffer, token.data, token.length);
+    buffer[token.length] = '\0';
+
+    value = strtoul(buffer, NULL, 10);
+    return true;
+}
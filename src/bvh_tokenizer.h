@@ -0,0 +1,110 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#include "bvh_float.h"
+
+using std::size_t;
+using std::string;
+
+// A token is a view into the mapped file, it is only valid while the
+// mapping that produced it is alive
+struct TOKEN
+{
+    const char * data;          // first character of the token
+    size_t length;              // number of characters in the token
+
+    TOKEN() { data = NULL; length = 0; }
+    TOKEN(const char * d, size_t l) { data = d; length = l; }
+
+    bool empty() const { return length == 0; }
+    const char * end() const { return data + length; }
+
+    bool operator==(const char * s) const {
+        return strncmp(data, s, length) == 0 && s[length] == '\0';
+    }
+    bool operator!=(const char * s) const { return !(*this == s); }
+
+    string str() const { return string(data, length); }
+};
+
+// Read only memory mapping of a whole file
+class MappedFile
+{
+    public:
+        MappedFile();
+        ~MappedFile();
+
+        bool open(const char * filename);
+        void close();
+
+        bool is_open() const { return mapping != NULL; }
+
+        const char * begin() const { return mapping; }
+        const char * end() const { return mapping + length; }
+        size_t size() const { return length; }
+
+    private:
+        MappedFile(const MappedFile &);
+        MappedFile & operator=(const MappedFile &);
+
+        const char * mapping;
+        size_t length;
+};
+
+// Splits a character range on whitespace, the same way "istream >> string" does
+class Tokenizer
+{
+    public:
+        Tokenizer(const char * begin, const char * end) { cursor = begin; last = end; }
+
+        // Returns the next token, or an empty token at the end of the input
+        inline TOKEN next();
+
+        // Reads the next token as an unsigned integer / float
+        bool next_uint(unsigned int & value);
+        inline bool next_float(float & value);
+
+        bool good() const { return cursor < last; }
+
+        // Drops the rest of the input
+        void skip_to_end() { cursor = last; }
+
+        const char * position() const { return cursor; }
+        const char * end() const { return last; }
+
+    private:
+        static inline bool is_space(char c) {
+            return c == ' ' || c == '\n' || c == '\r' || c == '\t' || c == '\v' || c == '\f';
+        }
+
+        const char * cursor;
+        const char * last;
+};
+
+inline TOKEN Tokenizer::next()
+{
+    while (cursor < last && is_space(*cursor))
+        cursor++;
+
+    const char * start = cursor;
+
+    while (cursor < last && !is_space(*cursor))
+        cursor++;
+
+    return TOKEN(start, cursor - start);
+}
+
+inline bool Tokenizer::next_float(float & value)
+{
+    TOKEN token = next();
+
+    if (token.empty())
+        return false;
+
+    value = parse_float(token.data, token.end(), last);
+    return true;
+}
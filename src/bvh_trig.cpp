@@ -0,0 +1,159 @@
+#include "bvh_trig.h"
+
+#include <cmath>
+
+#ifdef __SSE2__
+#  include <emmintrin.h>
+#endif
+
+static const float degrees_to_radians = 0.01745329251994329576923690768489f;
+
+// Minimax coefficients on [-pi/4, pi/4] (Cephes sinf/cosf)
+static const float sin_p0 = -1.9515295891e-4f;
+static const float sin_p1 = 8.3321608736e-3f;
+static const float sin_p2 = -1.6666654611e-1f;
+static const float cos_p0 = 2.443315711809948e-5f;
+static const float cos_p1 = -1.388731625493765e-3f;
+static const float cos_p2 = 4.166664568298827e-2f;
+
+// Taylor coefficients of glm::fastSin / glm::fastCos
+static const float fast_sin_p0 = -1.0f / 5040.0f;
+static const float fast_sin_p1 = 1.0f / 120.0f;
+static const float fast_sin_p2 = -1.0f / 6.0f;
+static const float fast_cos_p0 = -1.0f / 720.0f;
+static const float fast_cos_p1 = 1.0f / 24.0f;
+static const float fast_cos_p2 = -0.5f;
+
+static inline void sincos_exact(float degrees, float & s, float & c)
+{
+    // quarter turns, the remainder is within [-45, 45] degrees
+    float turns = nearbyintf(degrees * (1.0f / 90.0f));
+    int quadrant = (int) turns;
+    float x = (degrees - turns * 90.0f) * degrees_to_radians;
+    float z = x * x;
+
+    float sine = ((sin_p0 * z + sin_p1) * z + sin_p2) * z * x + x;
+    float cosine = ((cos_p0 * z + cos_p1) * z + cos_p2) * z * z - 0.5f * z + 1.0f;
+
+    if (quadrant & 1) {
+        float swap = sine;
+        sine = cosine;
+        cosine = swap;
+    }
+
+    s = (quadrant & 2) ? -sine : sine;
+    c = ((quadrant + 1) & 2) ? -cosine : cosine;
+}
+
+static inline void sincos_fast(float degrees, float & s, float & c)
+{
+    // half turns, the remainder is within [-90, 90] degrees
+    float turns = nearbyintf(degrees * (1.0f / 180.0f));
+    int half_turn = (int) turns;
+    float x = (degrees - turns * 180.0f) * degrees_to_radians;
+    float z = x * x;
+
+    float sine = ((fast_sin_p0 * z + fast_sin_p1) * z + fast_sin_p2) * z * x + x;
+    float cosine = ((fast_cos_p0 * z + fast_cos_p1) * z + fast_cos_p2) * z + 1.0f;
+
+    s = (half_turn & 1) ? -sine : sine;
+    c = (half_turn & 1) ? -cosine : cosine;
+}
+
+#ifdef __SSE2__
+static inline __m128 select_ps(__m128i mask, __m128 a, __m128 b)
+{
+    __m128 m = _mm_castsi128_ps(mask);
+    return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b));
+}
+
+// Mask of the lanes whose integer has "bit" set
+static inline __m128i bit_mask(__m128i value, int bit)
+{
+    return _mm_cmpeq_epi32(_mm_and_si128(value, _mm_set1_epi32(bit)), _mm_set1_epi32(bit));
+}
+
+static inline void sincos_exact4(__m128 degrees, __m128 & s, __m128 & c)
+{
+    __m128i quadrant = _mm_cvtps_epi32(_mm_mul_ps(degrees, _mm_set1_ps(1.0f / 90.0f)));
+    __m128 turns = _mm_cvtepi32_ps(quadrant);
+    __m128 x = _mm_mul_ps(_mm_sub_ps(degrees, _mm_mul_ps(turns, _mm_set1_ps(90.0f))),
+                          _mm_set1_ps(degrees_to_radians));
+    __m128 z = _mm_mul_ps(x, x);
+
+    __m128 sine = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(sin_p0), z), _mm_set1_ps(sin_p1));
+    sine = _mm_add_ps(_mm_mul_ps(sine, z), _mm_set1_ps(sin_p2));
+    sine = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(sine, z), x), x);
+
+    __m128 cosine = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(cos_p0), z), _mm_set1_ps(cos_p1));
+    cosine = _mm_add_ps(_mm_mul_ps(cosine, z), _mm_set1_ps(cos_p2));
+    cosine = _mm_mul_ps(_mm_mul_ps(cosine, z), z);
+    cosine = _mm_add_ps(_mm_sub_ps(cosine, _mm_mul_ps(_mm_set1_ps(0.5f), z)), _mm_set1_ps(1.0f));
+
+    __m128i swap = bit_mask(quadrant, 1);
+    __m128 swapped_sine = select_ps(swap, cosine, sine);
+    __m128 swapped_cosine = select_ps(swap, sine, cosine);
+
+    // sign flips as float sign bits
+    __m128 sine_sign = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(quadrant, _mm_set1_epi32(2)), 30));
+    __m128 cosine_sign = _mm_castsi128_ps(_mm_slli_epi32(
+        _mm_and_si128(_mm_add_epi32(quadrant, _mm_set1_epi32(1)), _mm_set1_epi32(2)), 30));
+
+    s = _mm_xor_ps(swapped_sine, sine_sign);
+    c = _mm_xor_ps(swapped_cosine, cosine_sign);
+}
+
+static inline void sincos_fast4(__m128 degrees, __m128 & s, __m128 & c)
+{
+    __m128i half_turn = _mm_cvtps_epi32(_mm_mul_ps(degrees, _mm_set1_ps(1.0f / 180.0f)));
+    __m128 turns = _mm_cvtepi32_ps(half_turn);
+    __m128 x = _mm_mul_ps(_mm_sub_ps(degrees, _mm_mul_ps(turns, _mm_set1_ps(180.0f))),
+                          _mm_set1_ps(degrees_to_radians));
+    __m128 z = _mm_mul_ps(x, x);
+
+    __m128 sine = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(fast_sin_p0), z), _mm_set1_ps(fast_sin_p1));
+    sine = _mm_add_ps(_mm_mul_ps(sine, z), _mm_set1_ps(fast_sin_p2));
+    sine = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(sine, z), x), x);
+
+    __m128 cosine = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(fast_cos_p0), z), _mm_set1_ps(fast_cos_p1));
+    cosine = _mm_add_ps(_mm_mul_ps(cosine, z), _mm_set1_ps(fast_cos_p2));
+    cosine = _mm_add_ps(_mm_mul_ps(cosine, z), _mm_set1_ps(1.0f));
+
+    __m128 sign = _mm_castsi128_ps(_mm_slli_epi32(half_turn, 31));
+
+    s = _mm_xor_ps(sine, sign);
+    c = _mm_xor_ps(cosine, sign);
+}
+#endif
+
+void sincos_degrees(const float * degrees, size_t count, float * sines, float * cosines,
+                    TRIG_PRECISION precision)
+{
+    size_t i = 0;
+
+#ifdef __SSE2__
+    if (precision == TRIG_EXACT) {
+        for (; i + 4 <= count; i += 4) {
+            __m128 s, c;
+            sincos_exact4(_mm_loadu_ps(degrees + i), s, c);
+            _mm_storeu_ps(sines + i, s);
+            _mm_storeu_ps(cosines + i, c);
+        }
+    }
+    else {
+        for (; i + 4 <= count; i += 4) {
+            __m128 s, c;
+            sincos_fast4(_mm_loadu_ps(degrees + i), s, c);
+            _mm_storeu_ps(sines + i, s);
+            _mm_storeu_ps(cosines + i, c);
+        }
+    }
+#endif
+
+    for (; i < count; i++) {
+        if (precision == TRIG_EXACT)
+            sincos_exact(degrees[i], sines[i], cosines[i]);
+        else
+            sincos_fast(degrees[i], sines[i], cosines[i]);
+    }
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstddef>
+
+// Sine and cosine of angles in degrees, evaluated in bulk over the motion block
+// so the FK kernels only read precomputed values.
+//
+// Angles are reduced in degrees (exactly, for any angle a capture will hold)
+// before the polynomial runs in radians:
+//
+//   TRIG_EXACT  reduces to [-45, 45] and uses minimax polynomials of degree
+//               7 (sin) and 8 (cos). Max absolute error 8.1e-8 against the
+//               double precision result, i.e. float rounding.
+//   TRIG_FAST   reduces to [-90, 90] and uses the truncated Taylor series of
+//               glm/gtx/fast_trigonometry.hpp (fastSin / fastCos). Max
+//               absolute error 1.6e-4 (sin) and 9.3e-4 (cos).
+//
+// With SSE2 four angles are evaluated per instruction, the remainder and
+// builds without SSE2 use the same polynomials one angle at a time.
+
+enum TRIG_PRECISION
+{
+    TRIG_EXACT,
+    TRIG_FAST
+};
+
+// Writes sin/cos of degrees[i] to sines[i]/cosines[i] for i in [0, count)
+void sincos_degrees(const float * degrees, size_t count, float * sines, float * cosines,
+                    TRIG_PRECISION precision = TRIG_EXACT);
@@ -0,0 +1,100 @@
+#include "bvh_loader.h"
+
+#include <cstdlib>
+
+// Files loaded per BVH::load_many call, so a library of any size is held a
+// batch at a time
+static const size_t batch_files = 256;
+
+static const char * channel_name(short channel)
+{
+    switch (channel) {
+        case BVH::Xposition: return "Xposition";
+        case BVH::Yposition: return "Yposition";
+        case BVH::Zposition: return "Zposition";
+        case BVH::Xrotation: return "Xrotation";
+        case BVH::Yrotation: return "Yrotation";
+        case BVH::Zrotation: return "Zrotation";
+        default: return "?";
+    }
+}
+
+// Prints a joint, its channel layout and its children indented below it
+static void print_joint(const JOINT * joint, int depth, ostream & stream)
+{
+    stream << string(depth * 2, ' ') << joint->name;
+
+    for (unsigned int i = 0; i < joint->num_channels; i++)
+        stream << ' ' << channel_name(joint->channels_order[i]);
+    stream << '\n';
+
+    for (const JOINT * child: joint->children)
+        print_joint(child, depth + 1, stream);
+}
+
+int main(int argc, char **argv)
+{
+    LOAD_OPTIONS options;
+    options.header_only = true;
+    options.use_cache = false;
+
+    bool list_joints = true;
+    vector<string> filenames;
+
+    for (int i = 1; i < argc; i++) {
+        string argument = argv[i];
+
+        if (argument == "-t" && i + 1 < argc)
+            options.threads = atoi(argv[++i]);
+        else if (argument == "-s")
+            list_joints = false;
+        else if (argument == "-h" || argument == "--help") {
+            std::cerr << "usage: bvhinfo [-t threads] [-s] [file.bvh ...]\n"
+                      << "Prints the joints, channels, frame count and frame time of every file,\n"
+                      << "read from the standard input one per line if none are given.\n"
+                      << "  -t  files loaded at once, 0 = one per core (default)\n"
+                      << "  -s  summary line only, without the joints\n";
+            return 0;
+        }
+        else
+            filenames.push_back(argument);
+    }
+
+    if (filenames.empty()) {
+        string line;
+        while (std::getline(std::cin, line))
+            if (!line.empty())
+                filenames.push_back(line);
+    }
+
+    int status = 0;
+
+    for (size_t first = 0; first < filenames.size(); first += batch_files) {
+        size_t last = std::min(first + batch_files, filenames.size());
+        vector<string> batch(filenames.begin() + first, filenames.begin() + last);
+        vector<BVH *> clips = BVH::load_many(batch, options);
+
+        for (size_t i = 0; i < clips.size(); i++) {
+            BVH * clip = clips[i];
+
+            if (!clip->good()) {
+                std::cerr << batch[i] << ": " << clip->error() << '\n';
+                status = 1;
+            }
+            else {
+                const SKELETON & skeleton = clip->getskeleton();
+
+                std::cout << batch[i] << ": " << clip->animation_frames() << " frames, "
+                          << clip->frame_time() << " s per frame, " << skeleton.num_joints << " joints, "
+                          << clip->motion_channels() << " channels\n";
+
+                if (list_joints)
+                    print_joint(clip->gethierarchy(), 1, std::cout);
+            }
+
+            delete clip;
+        }
+    }
+
+    return status;
+}
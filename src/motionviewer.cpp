@@ -2,10 +2,13 @@
 
 int main(int argc, char **argv)
 {
-	if (argc != 2)
+	// motionviewer [-f] file.bvh, -f follows a file that is still being written
+	bool follow = argc == 3 && std::string(argv[1]) == "-f";
+
+	if (argc != 2 && !follow)
 		return 1;
 
-	OpenGL * opengl = new OpenGL(argv[1]);
+	OpenGL * opengl = new OpenGL(argv[argc - 1], follow);
 
 	opengl->gl_init(argc, argv);
 
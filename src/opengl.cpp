@@ -3,7 +3,7 @@
 OpenGL * OpenGL::current_object;
 // int OpenGL::error_count = 0;
 
-OpenGL::OpenGL(const char * filename)
+OpenGL::OpenGL(const char * filename, bool follow)
 {
   window.width = 500.0;
   window.height = 500.0;
@@ -15,9 +15,10 @@ OpenGL::OpenGL(const char * filename)
   // Reset origins
   camera_origin = new origin(0.0, 0.0, 0.0);
   camera_angle = new origin(0.0, 0.0, 0.0);
+  camera_moved = false;
 
   // Load BVH
-  load(filename);
+  load(filename, follow);
 
   // Setup static current object
   current_object = this;
@@ -25,23 +26,128 @@ OpenGL::OpenGL(const char * filename)
 
 OpenGL::~OpenGL()
 {
-	// Clean up BVH data
-	delete bvh_data;
-
   // Clean up origins
   delete camera_origin;
   delete camera_angle;
 }
 
-void OpenGL::load(const char * filename)
+void OpenGL::load(const char * filename, bool follow)
 {
-	bvh_data = new BVH(filename);
+	// only the displayed frames are needed, so they are evaluated as playback reaches them,
+	// and playback starts as soon as the first frames are parsed
+	LOAD_OPTIONS options;
+	options.lazy_kinematics = true;
+	options.progressive = true;
+	options.tail = follow;
+
+	bvh_data.reset(new BVH(filename, options));
+	bvh_data->wait_frames(1);
+
+	following = follow;
+	last_poll = 0;
+	if (!follow)
+		source_watch.watch(filename);
+
+	if (!bvh_data->frames_ready()) {
+		std::cerr << bvh_data->error() << endl;
+		exit(1);
+	}
+
+	load_reported = false;
 	number_animation_frames = bvh_data->animation_frames();
 	current_frame = 0;
 }
 
+void OpenGL::report_load()
+{
+	// the loading thread writes the statistics until it is done
+	if (load_reported || bvh_data->loading())
+		return;
+	load_reported = true;
+
+	#ifdef OPENGLDEBUG
+	cout << "Preprocessing: " << bvh_data->preprocess_throughput() << " joint frames/s" << endl;
+	cout << "Positions: " << bvh_data->position_bytes() << " bytes, max error " << bvh_data->max_position_error() << endl;
+	#endif
+}
+
+void OpenGL::reload()
+{
+	// the clip on screen is only read by the reload, so playback goes on
+	std::shared_ptr<BVH> clip = bvh_data;
+
+	reload_result = std::async(std::launch::async, [clip]() {
+		return std::shared_ptr<BVH>(clip->reloaded());
+	});
+}
+
+void OpenGL::report_reload()
+{
+	if (!reload_result.valid() || reload_result.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+		return;
+
+	std::shared_ptr<BVH> clip = reload_result.get();
+
+	// a broken export leaves the clip on screen as it was
+	if (!clip->good() || !clip->frames_ready()) {
+		std::cerr << (clip->good() ? "no frames" : clip->error()) << endl;
+		return;
+	}
+
+	#ifdef OPENGLDEBUG
+	cout << "Reloaded: " << (clip->same_hierarchy(*bvh_data) ? "same" : "new") << " hierarchy, "
+	     << clip->changed_frames() << " of " << clip->animation_frames() << " frames evaluated" << endl;
+	#endif
+
+	bvh_data = clip;
+
+	number_animation_frames = bvh_data->animation_frames();
+	current_frame = std::min(current_frame, number_animation_frames - 1);
+}
+
+void OpenGL::save()
+{
+	// the hierarchy and the frames ready are never modified, so holding on to
+	// the clip is the snapshot; a core is left to playback
+	std::shared_ptr<BVH> clip = bvh_data;
+	unsigned int threads = std::max(std::thread::hardware_concurrency(), 2u) - 1;
+
+	// a clip still loading, a followed one always, is saved as far as it is ready
+	if (clip->loading())
+		cout << "Saving the frames loaded so far" << endl;
+
+	save_result = std::async(std::launch::async, [clip, threads]() {
+		return clip->write_bvh("output.bvh", threads);
+	});
+}
+
+void OpenGL::report_save()
+{
+	if (!save_result.valid() || save_result.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+		return;
+
+	if (save_result.get())
+		cout << "Saved output.bvh" << endl;
+	else
+		std::cerr << "output.bvh could not be written" << endl;
+}
+
 void OpenGL::gl_timer_function(int)
 {
+  current_object->report_save();
+  current_object->report_load();
+  current_object->report_reload();
+
+  // a re-exported file is picked up without restarting, the next change
+  // once the reload running is swapped in
+  int now = glutGet(GLUT_ELAPSED_TIME);
+  if (!current_object->following && !current_object->reload_result.valid() &&
+      now - current_object->last_poll >= reload_interval) {
+    current_object->last_poll = now;
+    if (current_object->source_watch.changed())
+      current_object->reload();
+  }
+
   glutPostRedisplay();
 	glutTimerFunc(current_object->delay, OpenGL::gl_timer_function, 0);
 }
@@ -76,6 +182,9 @@ void OpenGL::gl_camera_view()
   glm::vec3 animation_min = current_object->bvh_data->animation_minimum();
   glm::vec3 animation_max = current_object->bvh_data->animation_maximum();
 
+  current_object->framed_minimum = animation_min;
+  current_object->framed_maximum = animation_max;
+
   gluPerspective(25.0, (GLfloat)current_object->window.width / (GLfloat)current_object->window.height, 0.01, 1000.0);
 
   glMatrixMode(GL_MODELVIEW);
@@ -121,7 +230,11 @@ void OpenGL::increase_animation_speed()
 void OpenGL::gl_keyboard(unsigned char key, int, int)
 {
   if (key == 'w') {
-    current_object->bvh_data->save_bvh();
+    // one save at a time
+    if (current_object->save_result.valid())
+      cout << "output.bvh is still being saved" << endl;
+    else
+      current_object->save();
     return;
   }
 
@@ -129,6 +242,10 @@ void OpenGL::gl_keyboard(unsigned char key, int, int)
       case 27:
       case 'q':
       case 'Q':
+          // a save in progress is finished rather than left as a temporary file
+          if (current_object->save_result.valid())
+            current_object->save_result.wait();
+          current_object->report_save();
           exit(0);
           break;
 
@@ -221,6 +338,13 @@ void OpenGL::gl_special_keyboard(int key, int, int)
 
 void OpenGL::gl_display()
 {
+  // while frames come in the bounds grow, the camera keeps them in view
+  // unless it was moved
+  if (!current_object->camera_moved && current_object->bvh_data->loading() &&
+      (current_object->bvh_data->animation_minimum() != current_object->framed_minimum ||
+       current_object->bvh_data->animation_maximum() != current_object->framed_maximum))
+    gl_camera_view();
+
   // Introduce colors
   glClear(GL_COLOR_BUFFER_BIT);
   glColor3f(1.0, 1.0, 1.0);
@@ -247,6 +371,10 @@ void OpenGL::gl_display()
 
 	glutSwapBuffers();
 
+  if (current_object->camera_angle->x || current_object->camera_angle->y || current_object->camera_angle->z ||
+      current_object->camera_origin->x || current_object->camera_origin->y || current_object->camera_origin->z)
+    current_object->camera_moved = true;
+
   // Zero Camera
   current_object->camera_angle->zero();
   current_object->camera_origin->zero();
@@ -317,6 +445,8 @@ void OpenGL::render_min_max()
 
 void OpenGL::render_hierarchy()
 {
+	current_object->current_pose = current_object->bvh_data->frame_pose(current_object->current_frame);
+
 	render_joint(current_object->bvh_data->gethierarchy());
 
   // Only advance the frame if the animation is running
@@ -329,12 +459,12 @@ void OpenGL::render_joint(JOINT * parent_joint)
 	glPushMatrix();
 
 	if (parent_joint->parent != NULL) {
-		glm::vec4 * parent_vertex = current_vertex(parent_joint->parent);
-		glm::vec4 * joint_vertex = current_vertex(parent_joint);
+		glm::vec3 parent_vertex = current_vertex(parent_joint->parent);
+		glm::vec3 joint_vertex = current_vertex(parent_joint);
 
 		glBegin(GL_LINES);
-				glVertex3f(parent_vertex->x, parent_vertex->y, parent_vertex->z);
-				glVertex3f(joint_vertex->x, joint_vertex->y, joint_vertex->z);
+				glVertex3f(parent_vertex.x, parent_vertex.y, parent_vertex.z);
+				glVertex3f(joint_vertex.x, joint_vertex.y, joint_vertex.z);
 		glEnd();
 	}
 
@@ -347,12 +477,21 @@ void OpenGL::render_joint(JOINT * parent_joint)
 
 void OpenGL::next_animation_frame()
 {
+	// a followed file keeps growing
+	current_object->number_animation_frames = current_object->bvh_data->animation_frames();
 	assert(current_object->number_animation_frames);
-	current_object->current_frame = (current_object->current_frame + 1) % current_object->number_animation_frames;
+
+	// while the file loads, playback waits at the last frame that is in
+	unsigned int next = current_object->current_frame + 1;
+
+	if (next < current_object->bvh_data->frames_ready())
+		current_object->current_frame = next;
+	else if (!current_object->bvh_data->loading())
+		current_object->current_frame = next % current_object->bvh_data->frames_ready();
 }
 
-inline glm::vec4 * OpenGL::current_vertex(JOINT * joint)
+inline glm::vec3 OpenGL::current_vertex(JOINT * joint)
 {
 	assert(joint != NULL);
-	return &(joint->animation_frames[current_object->current_frame]);
+	return (*current_object->current_pose)[joint->index];
 }
@@ -9,6 +9,8 @@
 #endif
 
 #include <algorithm>
+#include <future>
+#include <memory>
 
 using std::max;
 
@@ -54,7 +56,8 @@ struct origin
 class OpenGL
 {
 	public:
-        OpenGL(const char * filename);
+        // With follow the file is tailed, frames appended to it are shown as they come
+        OpenGL(const char * filename, bool follow = false);
         ~OpenGL();
 
         // OpenGL Related Functions
@@ -70,13 +73,34 @@ class OpenGL
         // Whether the animation is being displayed or not
         bool animation_status;
 
-        // Contains the BVH data
-    	BVH * bvh_data;
+        // Contains the BVH data, shared with a save or reload in progress so
+        // the clip they read outlives being swapped out
+    	std::shared_ptr<BVH> bvh_data;
+
+        // Result of the save running in the background, valid until reported
+        std::future<bool> save_result;
+
+        // Whether the statistics of the load have been printed
+        bool load_reported;
+
+        // The file is polled every reload_interval ms and reloaded when it
+        // changes, unless it is followed
+        static constexpr int reload_interval = 250;
+        FileWatch source_watch;
+        std::future<std::shared_ptr<BVH> > reload_result;
+        bool following;
+        int last_poll;
 
         // Camera
         origin * camera_origin;
         origin * camera_angle;
 
+        // Bounds the camera was last placed for, it follows them as they grow
+        // until it is moved by hand
+        glm::vec3 framed_minimum;
+        glm::vec3 framed_maximum;
+        bool camera_moved;
+
         // Window
         box window;
 
@@ -88,6 +112,9 @@ class OpenGL
         unsigned int current_frame;
         unsigned int number_animation_frames;
 
+        // Joint positions of the frame being drawn
+        POSE current_pose;
+
         // Trampoline object
         static OpenGL * current_object;
 
@@ -101,14 +128,27 @@ class OpenGL
         static void invalidate_timer();
 
         // Loads BVH Data
-        void load(const char * filename);
+        void load(const char * filename, bool follow);
+
+        // Prints the load statistics once the file has finished loading
+        void report_load();
+
+        // Loads the file again in the background, and swaps the new clip in
+        // once it is ready, keeping the camera and the current frame
+        void reload();
+        void report_reload();
+
+        // Starts writing the clip, or the frames ready while it loads, to
+        // output.bvh in the background, and reports how it went once it has finished
+        void save();
+        void report_save();
 
 		static void render_hierarchy();
 		static void render_joint(JOINT * parent_joint);
         static void render_min_max();
 
 		static void next_animation_frame();					// Advances the animation by one frame
-		static inline glm::vec4 * current_vertex(JOINT * joint);	// Returns the vertex for the current animation frame
+		static inline glm::vec3 current_vertex(JOINT * joint);	// Returns the vertex for the current animation frame
 
         static void decrease_animation_speed();
         static void increase_animation_speed();
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+// Number of workers to use when the caller asked for "threads" (0 = one per core)
+inline unsigned int worker_count(unsigned int threads)
+{
+    if (threads == 0)
+        threads = std::thread::hardware_concurrency();
+
+    return threads ? threads : 1;
+}
+
+// Runs task(i) for every i in [0, count) on up to "threads" workers. Tasks are
+// handed out one at a time so uneven tasks still balance; the calling thread
+// takes part and the call returns once every task has finished.
+template <typename Task>
+void parallel_for(unsigned int count, unsigned int threads, Task task)
+{
+    threads = worker_count(threads);
+    if (threads > count)
+        threads = count;
+
+    if (threads <= 1) {
+        for (unsigned int i = 0; i < count; i++)
+            task(i);
+        return;
+    }
+
+    std::atomic<unsigned int> next(0);
+
+    auto worker = [&]() {
+        for (unsigned int i = next++; i < count; i = next++)
+            task(i);
+    };
+
+    std::vector<std::thread> pool;
+    for (unsigned int t = 1; t < threads; t++)
+        pool.push_back(std::thread(worker));
+
+    worker();
+
+    for (auto & thread: pool)
+        thread.join();
+}
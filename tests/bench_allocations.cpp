@@ -0,0 +1,124 @@
+// Counts the heap allocations of loading and unloading clips of growing
+// hierarchies. With the hierarchy and motion in the clip's arena the count
+// does not grow with the number of joints, and unloading frees a constant
+// handful of buffers. Only operator new is counted; the arena's own blocks
+// come from malloc.
+
+#include "bvh_loader.h"
+#include "test_clips.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <new>
+
+static std::atomic<size_t> allocations(0);
+static std::atomic<size_t> releases(0);
+
+void * operator new(size_t bytes)
+{
+    allocations++;
+
+    void * memory = malloc(bytes ? bytes : 1);
+    if (!memory)
+        throw std::bad_alloc();
+    return memory;
+}
+
+void * operator new[](size_t bytes)
+{
+    return operator new(bytes);
+}
+
+void operator delete(void * memory) noexcept
+{
+    if (memory) {
+        releases++;
+        free(memory);
+    }
+}
+
+void operator delete[](void * memory) noexcept
+{
+    operator delete(memory);
+}
+
+void operator delete(void * memory, size_t) noexcept
+{
+    operator delete(memory);
+}
+
+void operator delete[](void * memory, size_t) noexcept
+{
+    operator delete(memory);
+}
+
+// Frames of every clip, few enough to be parsed and preprocessed in one task
+static const unsigned int num_frames = 30;
+
+// Load/unload cycles timed per clip
+static const unsigned int cycles = 50;
+
+// Allocations a clip may need beyond those of the smallest one
+static const size_t allowed_growth = 4;
+
+// Frees an unload may take: the BVH object and its few buffers
+static const size_t allowed_releases = 4;
+
+int main()
+{
+    string directory = make_directory("bench_allocations");
+    const unsigned int joint_counts[] = { 10, 100, 1000 };
+
+    LOAD_OPTIONS options;
+    options.use_cache = false;
+    options.threads = 1;
+
+    size_t smallest_allocations = 0;
+
+    for (unsigned int joints: joint_counts) {
+        string filename = directory + "/clip.bvh";
+        write_text(filename, clip_text(joints, num_frames, joints, [](unsigned int frame, unsigned int channel) {
+            return (float) ((frame + channel) % 90);
+        }));
+
+        size_t load_allocations = 0;
+        size_t unload_releases = 0;
+        double load_seconds = 0;
+        double unload_seconds = 0;
+
+        for (unsigned int cycle = 0; cycle < cycles; cycle++) {
+            size_t before = allocations;
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+            BVH * clip = new BVH(filename.c_str(), options);
+
+            std::chrono::steady_clock::time_point loaded = std::chrono::steady_clock::now();
+            load_allocations = allocations - before;
+            check(clip->good(), filename + " loads");
+
+            size_t released = releases;
+            delete clip;
+
+            std::chrono::steady_clock::time_point unloaded = std::chrono::steady_clock::now();
+            unload_releases = releases - released;
+
+            load_seconds += std::chrono::duration<double>(loaded - start).count();
+            unload_seconds += std::chrono::duration<double>(unloaded - loaded).count();
+        }
+
+        if (!smallest_allocations)
+            smallest_allocations = load_allocations;
+
+        std::cout << joints << " joints: " << load_allocations << " allocations to load ("
+                  << load_seconds / cycles * 1e6 << " us), " << unload_releases << " frees to unload ("
+                  << unload_seconds / cycles * 1e6 << " us)\n";
+
+        check(load_allocations <= smallest_allocations + allowed_growth, "load allocations grow with the joints");
+        check(unload_releases <= allowed_releases, "unload frees more than the arena blocks");
+    }
+
+    remove_directory(directory);
+
+    std::cout << "bench_allocations: " << (failures() ? "FAILED" : "passed") << "\n";
+    return failures() ? 1 : 0;
+}
@@ -0,0 +1,142 @@
+// Evaluates single chains of joints of growing depth with BVH::advance_frame,
+// which starts each joint from its bind transform baked at load and moves
+// end sites by their offset alone, and with the per frame mat4 code it
+// replaced, which rebuilt every joint from glm::translate(mat4(1), offset)
+// and glm::rotate. Reports the time per joint frame of both and checks they
+// agree. Build with -O2 for representative numbers.
+
+#include "bvh_loader.h"
+#include "test_clips.h"
+
+#include <chrono>
+#include <cmath>
+#include <sstream>
+
+static const unsigned int num_frames = 200;
+
+// Text of a clip with a single chain of depth joints (the root with 6
+// channels, the others with 3 rotations) ending in an end site
+static string chain_text(unsigned int depth)
+{
+    std::ostringstream stream;
+    stream << "HIERARCHY\n";
+
+    for (unsigned int joint = 0; joint < depth; joint++) {
+        stream << (joint ? "JOINT J" : "ROOT J") << joint << "\n{\n";
+        stream << "OFFSET " << joint % 3 * 0.5 << " 1.5 " << joint % 5 * 0.25 << "\n";
+        stream << (joint ? "CHANNELS 3 Zrotation Xrotation Yrotation\n"
+                         : "CHANNELS 6 Xposition Yposition Zposition Zrotation Xrotation Yrotation\n");
+    }
+
+    stream << "End Site\n{\nOFFSET 0 1 0\n}\n";
+    for (unsigned int joint = 0; joint < depth; joint++)
+        stream << "}\n";
+
+    // small angles, so the end of a long chain stays in a sane range
+    unsigned int channels = 3 * depth + 3;
+    stream << "MOTION\nFrames: " << num_frames << "\nFrame Time: 0.0083333\n";
+
+    for (unsigned int frame = 0; frame < num_frames; frame++) {
+        for (unsigned int channel = 0; channel < channels; channel++)
+            stream << (channel ? " " : "") << (float) ((frame * 7 + channel * 3) % 21) * 0.25f - 2.5f;
+        stream << "\n";
+    }
+
+    return stream.str();
+}
+
+// The replaced evaluation of one frame: every joint's transform rebuilt from
+// its offset and channels with glm, then multiplied by its parent's
+static void advance_frame_mat4(const SKELETON & skeleton, const float * frame_data, vector<glm::mat4> & world)
+{
+    for (unsigned int joint = 0; joint < skeleton.num_joints; joint++) {
+        glm::mat4 matrix = glm::translate(glm::mat4(1.0), skeleton.offset[joint]);
+
+        for (unsigned int i = 0; i < skeleton.num_channels[joint]; i++) {
+            unsigned int channel = skeleton.channel_start[joint] + i;
+            short type = skeleton.channels_order[channel];
+            float value = frame_data[channel];
+
+            if (type & BVH::Xposition)
+                matrix = glm::translate(matrix, glm::vec3(value, 0, 0));
+            else if (type & BVH::Yposition)
+                matrix = glm::translate(matrix, glm::vec3(0, value, 0));
+            else if (type & BVH::Zposition)
+                matrix = glm::translate(matrix, glm::vec3(0, 0, value));
+            else if (type & BVH::Xrotation)
+                matrix = glm::rotate(matrix, value, glm::vec3(1, 0, 0));
+            else if (type & BVH::Yrotation)
+                matrix = glm::rotate(matrix, value, glm::vec3(0, 1, 0));
+            else if (type & BVH::Zrotation)
+                matrix = glm::rotate(matrix, value, glm::vec3(0, 0, 1));
+        }
+
+        int parent = skeleton.parent[joint];
+        world[joint] = parent >= 0 ? world[parent] * matrix : matrix;
+    }
+}
+
+static double seconds_since(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main()
+{
+    string directory = make_directory("bench_deep_skeleton");
+    const unsigned int depths[] = { 16, 128, 1024 };
+
+    LOAD_OPTIONS options;
+    options.use_cache = false;
+    options.lazy_kinematics = true;
+
+    for (unsigned int depth: depths) {
+        string filename = directory + "/chain.bvh";
+        write_text(filename, chain_text(depth));
+
+        BVH clip(filename.c_str(), options);
+        check(clip.good(), "a chain loads");
+        if (!clip.good())
+            continue;
+
+        const SKELETON & skeleton = clip.getskeleton();
+        unsigned int stride = clip.motion_channels();
+        vector<float> sines(stride), cosines(stride);
+        vector<AFFINE> world(skeleton.num_joints);
+        vector<glm::mat4> world_mat4(skeleton.num_joints);
+        float max_error = 0;
+        float extent = 0;
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (unsigned int frame = 0; frame < num_frames; frame++) {
+            const float * frame_data = clip.frame_values(frame);
+            sincos_degrees(frame_data, stride, sines.data(), cosines.data());
+            clip.advance_frame(frame_data, sines.data(), cosines.data(), world.data());
+        }
+        double baked = seconds_since(start);
+
+        start = std::chrono::steady_clock::now();
+        for (unsigned int frame = 0; frame < num_frames; frame++)
+            advance_frame_mat4(skeleton, clip.frame_values(frame), world_mat4);
+        double rebuilt = seconds_since(start);
+
+        // the last frame of both, the errors build up along the chain
+        for (unsigned int joint = 0; joint < skeleton.num_joints; joint++) {
+            glm::vec3 position(world_mat4[joint][3]);
+            max_error = std::max(max_error, glm::length(position - world[joint].translation()));
+            extent = std::max(extent, glm::length(position));
+        }
+
+        double joint_frames = (double) num_frames * skeleton.num_joints;
+        std::cout << depth << " joints deep: " << baked / joint_frames * 1e9 << " ns per joint frame, mat4 "
+                  << rebuilt / joint_frames * 1e9 << " ns (" << rebuilt / baked << "x), max difference "
+                  << max_error << " of " << extent << "\n";
+
+        check(max_error <= extent * 1e-4f, "the baked transforms agree with the mat4 ones");
+    }
+
+    remove_directory(directory);
+
+    std::cout << "bench_deep_skeleton: " << (failures() ? "FAILED" : "passed") << "\n";
+    return failures() ? 1 : 0;
+}
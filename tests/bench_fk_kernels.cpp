@@ -0,0 +1,92 @@
+// Times the FK kernels specialized for the common channel layouts (three
+// rotations, three positions followed by three rotations, in every rotation
+// order) against the generic kernel that walks the channels, and checks
+// both build the same local transforms. Build with -O2 for representative
+// numbers.
+
+#include "bvh_loader.h"
+#include "test_clips.h"
+
+#include <chrono>
+#include <random>
+
+// Frames of values each kernel is timed over, and rounds over them
+static const unsigned int num_frames = 4096;
+static const unsigned int rounds = 20;
+
+static const short rotations[] = { BVH::Xrotation, BVH::Yrotation, BVH::Zrotation };
+static const char * axis_names[] = { "X", "Y", "Z" };
+
+// Results are stored here so the timed loops are not optimized away
+static volatile float sink;
+
+// Seconds per local transform of one kernel over every frame
+static double time_kernel(FK_KERNEL kernel, const AFFINE & bind, const vector<float> & values,
+                          const vector<float> & sines, const vector<float> & cosines,
+                          const short * channels, unsigned int num_channels)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    for (unsigned int round = 0; round < rounds; round++)
+        for (unsigned int frame = 0; frame < num_frames; frame++) {
+            size_t row = (size_t) frame * num_channels;
+            AFFINE local = kernel(bind, &values[row], &sines[row], &cosines[row], channels, num_channels);
+            sink = local.row[0].w;
+        }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return seconds / rounds / num_frames;
+}
+
+// Checks and times the kernel of one layout against the generic kernel
+static void compare_layout(const short * channels, unsigned int num_channels, const string & name,
+                           std::mt19937 & random)
+{
+    std::uniform_real_distribution<float> angle(-180.0f, 180.0f);
+    vector<float> values((size_t) num_frames * num_channels);
+    vector<float> sines(values.size()), cosines(values.size());
+
+    for (float & value: values)
+        value = angle(random);
+    sincos_degrees(values.data(), values.size(), sines.data(), cosines.data());
+
+    AFFINE bind(glm::vec3(angle(random), angle(random), angle(random)));
+    FK_KERNEL kernel = select_fk_kernel(num_channels, channels);
+    check(kernel != generic_fk_kernel, name + ": has a specialized kernel");
+
+    bool same = true;
+    for (unsigned int frame = 0; frame < num_frames && same; frame++) {
+        size_t row = (size_t) frame * num_channels;
+        AFFINE a = kernel(bind, &values[row], &sines[row], &cosines[row], channels, num_channels);
+        AFFINE b = generic_fk_kernel(bind, &values[row], &sines[row], &cosines[row], channels, num_channels);
+
+        for (int i = 0; i < 3; i++)
+            same = same && a.row[i] == b.row[i];
+    }
+    check(same, name + ": the specialized kernel builds the transforms of the generic one");
+
+    double specialized = time_kernel(kernel, bind, values, sines, cosines, channels, num_channels);
+    double generic = time_kernel(generic_fk_kernel, bind, values, sines, cosines, channels, num_channels);
+
+    std::cout << name << ": " << specialized * 1e9 << " ns, generic " << generic * 1e9 << " ns ("
+              << generic / specialized << "x)\n";
+}
+
+int main()
+{
+    std::mt19937 random(8);
+
+    // every order of the three rotation axes, alone and after the positions
+    int order[] = { 0, 1, 2 };
+    do {
+        short joint[3] = { rotations[order[0]], rotations[order[1]], rotations[order[2]] };
+        short root[6] = { BVH::Xposition, BVH::Yposition, BVH::Zposition, joint[0], joint[1], joint[2] };
+        string axes = string(axis_names[order[0]]) + axis_names[order[1]] + axis_names[order[2]];
+
+        compare_layout(joint, 3, "rotations " + axes, random);
+        compare_layout(root, 6, "positions, rotations " + axes, random);
+    } while (std::next_permutation(order, order + 3));
+
+    std::cout << "bench_fk_kernels: " << (failures() ? "FAILED" : "passed") << "\n";
+    return failures() ? 1 : 0;
+}
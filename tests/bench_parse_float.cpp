@@ -0,0 +1,155 @@
+// Parses millions of generated decimals with parse_float() and checks every
+// result is bit for bit the one of strtof(), then reports the values per
+// second of parse_float(), strtof() and the "stringstream >> float" the
+// loader used to go through. The decimals mix what exporters write (fixed
+// precision, the SIMD path) with the shortest text of random floats, long
+// digit strings and exact float halfway points (the fallback paths). Like
+// the other benchmarks, build with -O2 for representative numbers.
+
+#include "bvh_loader.h"
+#include "test_clips.h"
+
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <sstream>
+
+static const unsigned int num_values = 5000000;
+
+// Values timed through a stringstream, which is much slower
+static const unsigned int stream_values = 200000;
+
+// Kinds of decimals, picked in turn
+enum { FIXED, SHORTEST, DIGITS, HALFWAY, SHORT_FORMS, KINDS };
+static const char * kind_names[] = { "fixed precision", "shortest", "long digit strings", "halfway points", "short forms" };
+
+// Appends one decimal of the given kind to text
+static void append_decimal(int kind, std::mt19937 & random, string & text)
+{
+    char number[64];
+
+    switch (kind) {
+        case FIXED: {
+            std::uniform_real_distribution<float> angle(-360.0f, 360.0f);
+            snprintf(number, sizeof(number), "%.*f", (int) (random() % 7), angle(random));
+            break;
+        }
+        case SHORTEST: {
+            uint32_t bits = random();
+            float value;
+            memcpy(&value, &bits, sizeof(value));
+            if (std::isnan(value) || std::isinf(value))
+                value = 0.0f;
+            snprintf(number, sizeof(number), "%.9g", value);
+            break;
+        }
+        case DIGITS: {
+            // up to 24 digits with the point anywhere
+            unsigned int digits = 1 + random() % 24;
+            unsigned int point = random() % (digits + 1);
+            char * p = number;
+            if (random() % 2)
+                *p++ = '-';
+            for (unsigned int i = 0; i < digits; i++) {
+                if (i == point)
+                    *p++ = '.';
+                *p++ = '0' + random() % 10;
+            }
+            *p = '\0';
+            break;
+        }
+        case HALFWAY: {
+            // the exact decimal of the double halfway between two floats
+            uint32_t bits = random() & 0x7effffff;
+            float low, high;
+            uint32_t next = bits + 1;
+            memcpy(&low, &bits, sizeof(low));
+            memcpy(&high, &next, sizeof(high));
+            snprintf(number, sizeof(number), "%.40g", ((double) low + (double) high) / 2);
+            break;
+        }
+        default: {
+            static const char * forms[] = { "0", "-0", "1", ".5", "5.", "-.25", "1e5", "1E-5", "2.5e+3",
+                                            "00012.5000", "1e-50", "3.4028236e38", "1e39", "7" };
+            snprintf(number, sizeof(number), "%s", forms[random() % (sizeof(forms) / sizeof(forms[0]))]);
+            break;
+        }
+    }
+
+    text += number;
+}
+
+// Results are stored here so the timed loops are not optimized away
+static volatile float sink;
+
+static double seconds_since(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main()
+{
+    std::mt19937 random(2);
+    string text;
+    vector<size_t> starts(num_values + 1);
+
+    // tokens separated like frame values, so strtof() stops at the end of each
+    for (unsigned int i = 0; i < num_values; i++) {
+        starts[i] = text.size();
+        append_decimal(i % KINDS, random, text);
+        text += ' ';
+    }
+    starts[num_values] = text.size();
+
+    const char * begin = text.data();
+    const char * limit = begin + text.size();
+    unsigned int mismatches[KINDS] = { 0 };
+
+    for (unsigned int i = 0; i < num_values; i++) {
+        const char * token = begin + starts[i];
+        const char * end = begin + starts[i + 1] - 1;
+        float parsed = parse_float(token, end, limit);
+        float expected = strtof(token, NULL);
+
+        if (memcmp(&parsed, &expected, sizeof(float)) != 0 && mismatches[i % KINDS]++ < 5)
+            std::cerr << string(token, end) << ": " << parsed << " instead of " << expected << "\n";
+    }
+
+    for (int kind = 0; kind < KINDS; kind++)
+        check(mismatches[kind] == 0, string(kind_names[kind]) + ": parse_float differs from strtof");
+    std::cout << num_values << " values checked against strtof\n";
+
+    // throughput of each path over the same tokens, all of them and the
+    // fixed precision ones frame lines are made of
+    const unsigned int steps[] = { 1, KINDS };
+    for (unsigned int step: steps) {
+        unsigned int count = num_values / step;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (unsigned int i = 0; i < num_values; i += step)
+            sink = parse_float(begin + starts[i], begin + starts[i + 1] - 1, limit);
+        double parse_rate = count / seconds_since(start);
+
+        start = std::chrono::steady_clock::now();
+        for (unsigned int i = 0; i < num_values; i += step)
+            sink = strtof(begin + starts[i], NULL);
+        double strtof_rate = count / seconds_since(start);
+
+        start = std::chrono::steady_clock::now();
+        for (unsigned int i = 0; i < stream_values; i += step) {
+            std::stringstream stream;
+            float value;
+            stream << string(begin + starts[i], begin + starts[i + 1] - 1);
+            stream >> value;
+            sink = value;
+        }
+        double stream_rate = stream_values / step / seconds_since(start);
+
+        std::cout << (step == 1 ? "every kind" : kind_names[FIXED]) << ":\n";
+        std::cout << "  parse_float: " << parse_rate / 1e6 << " M values/s\n";
+        std::cout << "  strtof: " << strtof_rate / 1e6 << " M values/s (parse_float " << parse_rate / strtof_rate << "x)\n";
+        std::cout << "  stringstream: " << stream_rate / 1e6 << " M values/s (parse_float " << parse_rate / stream_rate << "x)\n";
+    }
+
+    std::cout << "bench_parse_float: " << (failures() ? "FAILED" : "passed") << "\n";
+    return failures() ? 1 : 0;
+}
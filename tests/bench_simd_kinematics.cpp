@@ -0,0 +1,60 @@
+// Preprocesses the same clip with the scalar forward kinematics and with
+// LOAD_OPTIONS::simd_kinematics, which evaluates BVH::simd_frames frames at
+// once, one per SSE lane. Reports the joint frames per second of both and
+// checks they give the same poses.
+
+#include "bvh_loader.h"
+#include "test_clips.h"
+
+static const unsigned int num_joints = 60;
+static const unsigned int num_frames = 3001;
+
+// Loads the clip on one worker and reports its preprocessing throughput
+static BVH * preprocess(const string & filename, bool simd, const string & label)
+{
+    LOAD_OPTIONS options;
+    options.use_cache = false;
+    options.threads = 1;
+    options.simd_kinematics = simd;
+
+    BVH * clip = new BVH(filename.c_str(), options);
+    check(clip->good(), label + ": the clip loads");
+
+    std::cout << label << ": " << clip->preprocess_throughput() << " joint frames/s\n";
+    return clip;
+}
+
+int main()
+{
+    string directory = make_directory("bench_simd_kinematics");
+    string filename = directory + "/clip.bvh";
+
+    write_text(filename, clip_text(num_joints, num_frames, 9, [](unsigned int frame, unsigned int channel) {
+        return (float) ((frame * 3 + channel * 17) % 720) * 0.5f - 180.0f;
+    }));
+
+    BVH * scalar = preprocess(filename, false, "scalar");
+    BVH * simd = preprocess(filename, true, "simd");
+
+#ifdef BVH_SIMD_KINEMATICS
+    std::cout << "speedup: " << simd->preprocess_throughput() / scalar->preprocess_throughput() << "x\n";
+#else
+    std::cout << "no SSE2, both ran the scalar kinematics\n";
+#endif
+
+    // the frame count is not a multiple of the lanes, so the last batch is short
+    bool same_poses = scalar->good() && simd->good();
+    for (unsigned int frame = 0; frame < num_frames && same_poses; frame++)
+        same_poses = *scalar->frame_pose(frame) == *simd->frame_pose(frame);
+    check(same_poses, "the SIMD kinematics give the poses of the scalar ones");
+
+    check(scalar->animation_minimum() == simd->animation_minimum() &&
+          scalar->animation_maximum() == simd->animation_maximum(), "both give the same bounds");
+
+    delete scalar;
+    delete simd;
+    remove_directory(directory);
+
+    std::cout << "bench_simd_kinematics: " << (failures() ? "FAILED" : "passed") << "\n";
+    return failures() ? 1 : 0;
+}
@@ -0,0 +1,112 @@
+// Reads a generated clip through "istream >> string", the way the loader used
+// to, and through the memory mapped Tokenizer, checks both see the same
+// tokens and reports the MB/s of each. Also times a whole load the old way,
+// with a stringstream per motion value, against BVH. The Makefile builds
+// without optimization, which leaves the inline Tokenizer behind the
+// optimized standard library; build with -O2 for representative numbers.
+
+#include "bvh_loader.h"
+#include "test_clips.h"
+
+#include <chrono>
+#include <fstream>
+#include <sstream>
+
+static const unsigned int num_joints = 40;
+static const unsigned int num_frames = 3000;
+
+static double seconds_since(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main()
+{
+    string directory = make_directory("bench_tokenizer");
+    string filename = directory + "/clip.bvh";
+
+    write_text(filename, clip_text(num_joints, num_frames, 1, [](unsigned int frame, unsigned int channel) {
+        return (float) ((frame * 7 + channel * 29) % 3600) * 0.1f - 180.0f;
+    }));
+
+    MappedFile file;
+    check(file.open(filename.c_str()), "the clip maps");
+    double megabytes = file.size() / 1e6;
+
+    // every token as a string
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::ifstream stream(filename.c_str());
+    string token;
+    size_t stream_tokens = 0;
+
+    while (stream >> token)
+        stream_tokens++;
+    double stream_rate = megabytes / seconds_since(start);
+
+    // every token as a view into the mapping
+    start = std::chrono::steady_clock::now();
+    Tokenizer tokens(file.begin(), file.end());
+    size_t mapped_tokens = 0;
+
+    while (!tokens.next().empty())
+        mapped_tokens++;
+    double mapped_rate = megabytes / seconds_since(start);
+
+    std::cout << "istream >> string: " << stream_rate << " MB/s\n";
+    std::cout << "Tokenizer: " << mapped_rate << " MB/s (" << mapped_rate / stream_rate << "x)\n";
+    check(stream_tokens == mapped_tokens, "both read the same number of tokens");
+
+    std::ifstream again(filename.c_str());
+    Tokenizer same_tokens(file.begin(), file.end());
+    bool same = true;
+
+    while (same && again >> token)
+        same = same_tokens.next() == token.c_str();
+    check(same && same_tokens.next().empty(), "both read the same tokens");
+
+    // the old loader converted every motion value through its own stringstream
+    start = std::chrono::steady_clock::now();
+    std::ifstream old_load(filename.c_str());
+    vector<float> values;
+    bool motion = false;
+
+    while (old_load >> token) {
+        if (motion) {
+            std::stringstream value;
+            float x;
+            value << token;
+            value >> x;
+            values.push_back(x);
+        }
+        else if (token == "Time:") {
+            old_load >> token;
+            motion = true;
+        }
+    }
+    double old_rate = megabytes / seconds_since(start);
+
+    // lazily, so the time is the parse and not the kinematics
+    LOAD_OPTIONS options;
+    options.use_cache = false;
+    options.threads = 1;
+    options.lazy_kinematics = true;
+
+    start = std::chrono::steady_clock::now();
+    BVH clip(filename.c_str(), options);
+    double load_rate = megabytes / seconds_since(start);
+
+    std::cout << "istream load: " << old_rate << " MB/s\n";
+    std::cout << "BVH load: " << load_rate << " MB/s (" << load_rate / old_rate << "x)\n";
+    check(clip.good() && values.size() == (size_t) num_frames * clip.motion_channels(), "both load every value");
+
+    bool same_values = clip.good();
+    for (size_t i = 0; i < values.size() && same_values; i++)
+        same_values = clip.frame_values(i / clip.motion_channels())[i % clip.motion_channels()] == values[i];
+    check(same_values, "both load the same values");
+
+    file.close();
+    remove_directory(directory);
+
+    std::cout << "bench_tokenizer: " << (failures() ? "FAILED" : "passed") << "\n";
+    return failures() ? 1 : 0;
+}
@@ -0,0 +1,119 @@
+// Loads clips with a malformed frame line and checks that the failure is
+// reported, whenever and however the line is parsed
+
+#include "bvh_loader.h"
+#include "test_clips.h"
+
+#include <sstream>
+
+// Over a megabyte of frame lines, so a load with several workers splits them
+static const unsigned int num_joints = 20;
+static const unsigned int num_frames = 4000;
+static const unsigned int bad_frame = 3000;
+
+// Text of a clip whose frame line "frame" is replaced by "line"
+static string clip_with_line(unsigned int frame, const string & line)
+{
+    string text = clip_text(num_joints, num_frames, 3, [](unsigned int frame, unsigned int channel) {
+        return (float) ((frame * 11 + channel * 5) % 90) - 44.75f;
+    });
+
+    size_t start = text.find('\n', text.find("Frame Time:")) + 1;
+    for (unsigned int i = 0; i < frame; i++)
+        start = text.find('\n', start) + 1;
+
+    return text.replace(start, text.find('\n', start) - start, line);
+}
+
+// A frame line of "count" values
+static string values_line(unsigned int count)
+{
+    string line = "1";
+    for (unsigned int i = 1; i < count; i++)
+        line += " 1";
+    return line;
+}
+
+// A file loaded serially, on several workers and progressively is rejected
+// the same way
+static void check_rejected(const string & filename, const string & error, const string & label)
+{
+    LOAD_OPTIONS options;
+    options.use_cache = false;
+
+    options.threads = 1;
+    BVH serial(filename.c_str(), options);
+    check(!serial.good() && serial.error() == error, label + ", serial load: " + serial.error());
+
+    options.threads = 4;
+    BVH parallel(filename.c_str(), options);
+    check(!parallel.good() && parallel.error() == error, label + ", 4 workers: " + parallel.error());
+
+    options.frame_stride = 2;
+    BVH strided(filename.c_str(), options);
+    check(!strided.good(), label + ", every other frame: " + strided.error());
+    options.frame_stride = 1;
+
+    options.progressive = true;
+    BVH progressive(filename.c_str(), options);
+    progressive.wait_frames(num_frames);
+    check(!progressive.good() && progressive.error() == error, label + ", progressive load: " + progressive.error());
+}
+
+// A bad line parsed on demand fails every load_frames() covering it, also
+// once it has been parsed by the bounds or an earlier call
+static void check_frame_index(const string & filename, const string & label)
+{
+    LOAD_OPTIONS options;
+    options.use_cache = false;
+    options.frame_index = true;
+
+    BVH clip(filename.c_str(), options);
+    check(clip.good(), label + ": the hierarchy and index load");
+
+    check(clip.load_frames(0, bad_frame), label + ": the frames before the bad line load");
+    check(!clip.load_frames(0, num_frames), label + ": loading every frame fails");
+    check(!clip.load_frames(bad_frame, bad_frame + 1), label + ": loading the bad frame again fails");
+    check(!clip.load_frames(bad_frame - 1, bad_frame + 2), label + ": loading a range around it fails");
+    check(clip.load_frames(bad_frame + 1, num_frames), label + ": the frames after the bad line load");
+
+    BVH first(filename.c_str(), options);
+    check(!first.load_frames(bad_frame, bad_frame + 1), label + ": loading the bad frame first fails");
+    check(!first.load_frames(0, num_frames), label + ": loading every frame after it fails");
+}
+
+int main()
+{
+    string directory = make_directory("test_bad_lines");
+    string short_line = directory + "/short.bvh";
+    string long_line = directory + "/long.bvh";
+    string truncated = directory + "/truncated.bvh";
+
+    unsigned int channels = clip_channels(num_joints);
+    std::ostringstream bad_values;
+    bad_values << "frame " << bad_frame << " does not have " << channels << " channel values";
+
+    write_text(short_line, clip_with_line(bad_frame, "1 2 3"));
+    write_text(long_line, clip_with_line(bad_frame, values_line(channels + 1)));
+
+    string text = clip_with_line(0, values_line(channels));
+    size_t cut = text.size();
+    for (unsigned int i = 0; i <= num_frames - bad_frame; i++)
+        cut = text.rfind('\n', cut - 1);
+    write_text(truncated, text.substr(0, cut + 1));
+
+    std::ostringstream missing_lines;
+    missing_lines << "found " << bad_frame << " frame lines, expected " << num_frames;
+
+    check_rejected(short_line, bad_values.str(), "short line");
+    check_rejected(long_line, bad_values.str(), "long line");
+    check_rejected(truncated, missing_lines.str(), "truncated file");
+
+    check_frame_index(short_line, "short line, frame index");
+    check_frame_index(long_line, "long line, frame index");
+
+    remove_directory(directory);
+
+    std::cout << "test_bad_lines: " << (failures() ? "FAILED" : "passed") << "\n";
+    return failures() ? 1 : 0;
+}
@@ -0,0 +1,121 @@
+#include "test_clips.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <vector>
+
+#include <unistd.h>
+
+static unsigned int failed_checks = 0;
+
+static const char * rotations[] = { "Zrotation Xrotation Yrotation", "Xrotation Yrotation Zrotation",
+                                    "Yrotation Zrotation Xrotation", "Zrotation Yrotation Xrotation" };
+
+// Writes a joint, its children and an end site for a leaf
+static void joint_text(unsigned int joint, const std::vector<std::vector<unsigned int> > & children,
+                       std::mt19937 & random, std::ostream & stream, int depth)
+{
+    std::string tab(depth, '\t');
+    std::uniform_real_distribution<float> offset(-10.0f, 10.0f);
+
+    stream << tab << (joint ? "JOINT J" : "ROOT J") << joint << "\n" << tab << "{\n";
+    stream << tab << "\tOFFSET " << offset(random) << " " << offset(random) << " " << offset(random) << "\n";
+
+    if (joint)
+        stream << tab << "\tCHANNELS 3 " << rotations[random() % 4] << "\n";
+    else
+        stream << tab << "\tCHANNELS 6 Xposition Yposition Zposition Zrotation Xrotation Yrotation\n";
+
+    for (unsigned int child: children[joint])
+        joint_text(child, children, random, stream, depth + 1);
+
+    if (children[joint].empty())
+        stream << tab << "\tEnd Site\n" << tab << "\t{\n" << tab << "\t\tOFFSET 0 1 0\n" << tab << "\t}\n";
+
+    stream << tab << "}\n";
+}
+
+std::string clip_text(unsigned int num_joints, unsigned int num_frames, unsigned int seed, const CHANNEL_VALUE & value)
+{
+    std::mt19937 random(seed);
+
+    // chains of a few joints branching off earlier joints
+    std::vector<std::vector<unsigned int> > children(num_joints);
+    for (unsigned int joint = 1; joint < num_joints; joint++) {
+        unsigned int parent = joint % 4 ? joint - 1 : random() % joint;
+        children[parent].push_back(joint);
+    }
+
+    std::ostringstream stream;
+    stream << "HIERARCHY\n";
+    joint_text(0, children, random, stream, 0);
+
+    stream << "MOTION\nFrames: " << num_frames << "\nFrame Time: 0.0083333\n";
+
+    unsigned int channels = clip_channels(num_joints);
+    char number[32];
+
+    for (unsigned int frame = 0; frame < num_frames; frame++) {
+        for (unsigned int channel = 0; channel < channels; channel++) {
+            snprintf(number, sizeof(number), channel ? " %.9g" : "%.9g", value(frame, channel));
+            stream << number;
+        }
+        stream << "\n";
+    }
+
+    return stream.str();
+}
+
+unsigned int clip_channels(unsigned int num_joints)
+{
+    return num_joints ? 3 * num_joints + 3 : 0;
+}
+
+bool write_text(const std::string & filename, const std::string & text)
+{
+    FILE * file = fopen(filename.c_str(), "wb");
+    if (!file)
+        return false;
+
+    bool written = fwrite(text.data(), 1, text.size(), file) == text.size();
+    return fclose(file) == 0 && written;
+}
+
+std::string make_directory(const char * test_name)
+{
+    const char * temp = getenv("TMPDIR");
+    std::string pattern = std::string(temp ? temp : "/tmp") + "/" + test_name + ".XXXXXX";
+
+    std::vector<char> name(pattern.begin(), pattern.end());
+    name.push_back('\0');
+
+    if (!mkdtemp(name.data())) {
+        std::cerr << "cannot create a directory from " << pattern << "\n";
+        exit(1);
+    }
+
+    return name.data();
+}
+
+void remove_directory(const std::string & directory)
+{
+    std::string command = "rm -rf '" + directory + "'";
+    if (system(command.c_str()) != 0)
+        std::cerr << "cannot remove " << directory << "\n";
+}
+
+void check(bool passed, const std::string & what)
+{
+    if (!passed) {
+        std::cerr << "FAILED: " << what << "\n";
+        failed_checks++;
+    }
+}
+
+unsigned int failures()
+{
+    return failed_checks;
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <functional>
+#include <string>
+
+// Channel value of a generated clip for a frame and a channel
+typedef std::function<float (unsigned int frame, unsigned int channel)> CHANNEL_VALUE;
+
+// Text of a clip with num_joints joints (the root with 6 channels, the others
+// with 3 rotations in an order picked by seed) and num_frames frames. Values
+// are written with 9 significant digits, so they load as exactly value().
+std::string clip_text(unsigned int num_joints, unsigned int num_frames, unsigned int seed, const CHANNEL_VALUE & value);
+
+// Number of channels of a clip_text() clip of num_joints joints
+unsigned int clip_channels(unsigned int num_joints);
+
+// Writes text to a file, false if it could not be written
+bool write_text(const std::string & filename, const std::string & text);
+
+// Creates an empty directory for a test's files, removed by remove_directory()
+std::string make_directory(const char * test_name);
+void remove_directory(const std::string & directory);
+
+// Reports a failed check and counts it
+void check(bool passed, const std::string & what);
+
+// Checks failed so far
+unsigned int failures();
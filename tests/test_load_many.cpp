@@ -0,0 +1,112 @@
+// Loads a few hundred generated clips at once with BVH::load_many and checks
+// every one against a serial load of the same file
+
+#include "bvh_loader.h"
+#include "test_clips.h"
+
+#include <sstream>
+
+// Generated files, each also requested a second time and with a missing
+// and a malformed one among them
+static const unsigned int num_files = 300;
+
+// Whether two loads of a file gave the same clip
+static bool same_clip(BVH & a, BVH & b)
+{
+    if (a.good() != b.good() || a.error() != b.error())
+        return false;
+    if (!a.good())
+        return true;
+
+    const SKELETON & x = a.getskeleton();
+    const SKELETON & y = b.getskeleton();
+
+    if (x.num_joints != y.num_joints || a.animation_frames() != b.animation_frames() ||
+        a.motion_channels() != b.motion_channels() || a.frame_time() != b.frame_time())
+        return false;
+
+    for (unsigned int joint = 0; joint < x.num_joints; joint++)
+        if (x.parent[joint] != y.parent[joint] || x.offset[joint] != y.offset[joint] ||
+            x.channel_start[joint] != y.channel_start[joint] || x.num_channels[joint] != y.num_channels[joint] ||
+            strcmp(x.name[joint], y.name[joint]) != 0)
+            return false;
+
+    for (unsigned int frame = 0; frame < a.animation_frames(); frame++) {
+        if (memcmp(a.frame_values(frame), b.frame_values(frame), a.motion_channels() * sizeof(float)) != 0)
+            return false;
+
+        if (*a.frame_pose(frame) != *b.frame_pose(frame))
+            return false;
+    }
+
+    return a.animation_minimum() == b.animation_minimum() && a.animation_maximum() == b.animation_maximum();
+}
+
+static void check_load_many(const vector<string> & filenames, const LOAD_OPTIONS & options, const string & label)
+{
+    vector<BVH *> clips = BVH::load_many(filenames, options);
+    check(clips.size() == filenames.size(), label + ": one clip per file");
+
+    for (size_t i = 0; i < clips.size(); i++) {
+        BVH serial(filenames[i].c_str(), options);
+        check(same_clip(*clips[i], serial), label + ": " + filenames[i] + " differs from a serial load");
+        delete clips[i];
+    }
+}
+
+int main()
+{
+    string directory = make_directory("test_load_many");
+    vector<string> filenames;
+
+    for (unsigned int i = 0; i < num_files; i++) {
+        unsigned int joints = 1 + i % 40;
+        unsigned int frames = 1 + (i * 37) % 200;
+
+        std::ostringstream name;
+        name << directory << "/clip" << i << ".bvh";
+        filenames.push_back(name.str());
+
+        string text = clip_text(joints, frames, i, [i](unsigned int frame, unsigned int channel) {
+            return (float) ((frame * 7 + channel * 13 + i) % 360) - 180.0f;
+        });
+
+        if (!write_text(name.str(), text)) {
+            std::cerr << "cannot write " << name.str() << "\n";
+            return 1;
+        }
+    }
+
+    write_text(directory + "/malformed.bvh", "HIERARCHY\nROOT J0\n{\n\tOFFSET 0 0 0\n");
+    filenames.push_back(directory + "/malformed.bvh");
+    filenames.push_back(directory + "/missing.bvh");
+
+    // the same files again, loaded concurrently with their first copy
+    for (unsigned int i = 0; i < num_files; i += 3)
+        filenames.push_back(filenames[i]);
+
+    LOAD_OPTIONS options;
+    options.use_cache = false;
+
+    options.threads = 0;
+    check_load_many(filenames, options, "one worker per core");
+
+    // more workers than the machine may have cores, so files do load concurrently
+    options.threads = 8;
+    check_load_many(filenames, options, "8 workers");
+
+    // concurrent loads writing and reading the same sidecars
+    options.use_cache = true;
+    check_load_many(filenames, options, "8 workers with sidecars");
+    check_load_many(filenames, options, "8 workers from sidecars");
+
+    options.use_cache = false;
+    options.lazy_kinematics = true;
+    check_load_many(filenames, options, "8 workers, lazy kinematics");
+
+    remove_directory(directory);
+
+    std::cout << "test_load_many: " << filenames.size() << " files, "
+              << (failures() ? "FAILED" : "passed") << "\n";
+    return failures() ? 1 : 0;
+}
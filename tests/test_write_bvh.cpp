@@ -0,0 +1,184 @@
+// Writes clips with BVH::write_bvh and checks that loading the output gives
+// back exactly the same motion values, including the values that take the
+// longest text
+
+#include "bvh_loader.h"
+#include "test_clips.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <random>
+
+// Large enough for several rounds of chunks on 4 workers
+static const unsigned int long_frames = 12000;
+static const unsigned int long_joints = 40;
+
+// Floats whose shortest text takes all format_float_chars characters, like
+// "-0.0000100000025" just below -1e-5
+static vector<float> longest_values(size_t count)
+{
+    vector<float> values;
+    uint32_t bits;
+    float value = -1e-5f;
+    memcpy(&bits, &value, sizeof(bits));
+
+    while (values.size() < count) {
+        char text[format_float_chars];
+        memcpy(&value, &bits, sizeof(value));
+
+        if (format_float(value, text) - text == (ptrdiff_t) format_float_chars)
+            values.push_back(value);
+        bits++;
+    }
+
+    return values;
+}
+
+// Floats that need all 9 significant digits to read back
+static vector<float> nine_digit_values(size_t count, std::mt19937 & random)
+{
+    vector<float> values;
+    std::uniform_real_distribution<float> range(-1000.0f, 1000.0f);
+
+    while (values.size() < count) {
+        float value = range(random);
+        char text[32];
+        snprintf(text, sizeof(text), "%.8g", value);
+
+        if (strtof(text, NULL) != value)
+            values.push_back(value);
+    }
+
+    return values;
+}
+
+// Every kind of value at once: edge cases, subnormals, the longest ones,
+// 9 digit ones and random bit patterns
+static vector<float> mixed_values(std::mt19937 & random)
+{
+    vector<float> values = { 0.0f, -0.0f, 1.0f, -1.0f, 0.1f, 1e-5f, -1e-5f, 9.99999e-6f, 1e9f, -1e9f,
+                             999999936.0f, 16777216.0f, 16777218.0f, FLT_MAX, -FLT_MAX, FLT_MIN, -FLT_MIN,
+                             FLT_EPSILON, 123.456f, -179.99998f };
+
+    // subnormals, the smallest ones and the largest
+    for (uint32_t bits = 1; bits < 64; bits++) {
+        float value;
+        uint32_t largest = 0x007fffff - bits;
+        memcpy(&value, &bits, sizeof(value));
+        values.push_back(value);
+        values.push_back(-value);
+        memcpy(&value, &largest, sizeof(value));
+        values.push_back(value);
+    }
+
+    vector<float> longest = longest_values(500);
+    vector<float> nine_digits = nine_digit_values(500, random);
+    values.insert(values.end(), longest.begin(), longest.end());
+    values.insert(values.end(), nine_digits.begin(), nine_digits.end());
+
+    while (values.size() < 4000) {
+        uint32_t bits = random();
+        float value;
+        memcpy(&value, &bits, sizeof(value));
+
+        if (!std::isnan(value) && !std::isinf(value))
+            values.push_back(value);
+    }
+
+    std::shuffle(values.begin(), values.end(), random);
+    return values;
+}
+
+// Loads a clip_text() clip of "values", writes it on 1 and on 4 workers and
+// checks both outputs are the same and load back as the same clip
+static void check_round_trip(const string & directory, const string & name, unsigned int joints,
+                             unsigned int frames, const vector<float> & values)
+{
+    string source = directory + "/" + name + ".bvh";
+    string serial_output = directory + "/" + name + "_serial.bvh";
+    string parallel_output = directory + "/" + name + "_parallel.bvh";
+
+    write_text(source, clip_text(joints, frames, joints, [&](unsigned int frame, unsigned int channel) {
+        return values[((size_t) frame * clip_channels(joints) + channel) % values.size()];
+    }));
+
+    LOAD_OPTIONS options;
+    options.use_cache = false;
+
+    BVH clip(source.c_str(), options);
+    check(clip.good() && clip.animation_frames() == frames, name + ": the source loads");
+    if (!clip.good())
+        return;
+
+    unsigned int channels = clip.motion_channels();
+    bool loaded_exactly = true;
+
+    // the source text has 9 digits, so it already loads as exactly these values
+    for (unsigned int frame = 0; frame < frames; frame++)
+        for (unsigned int channel = 0; channel < channels; channel++) {
+            float expected = values[((size_t) frame * channels + channel) % values.size()];
+            loaded_exactly = loaded_exactly && memcmp(&clip.frame_values(frame)[channel], &expected, sizeof(float)) == 0;
+        }
+    check(loaded_exactly, name + ": the source loads as the generated values");
+
+    check(clip.write_bvh(serial_output.c_str(), 1), name + ": written on 1 worker");
+    check(clip.write_bvh(parallel_output.c_str(), 4), name + ": written on 4 workers");
+
+    BVH serial(serial_output.c_str(), options);
+    BVH parallel(parallel_output.c_str(), options);
+
+    std::ifstream serial_file(serial_output.c_str(), std::ios::binary);
+    std::ifstream parallel_file(parallel_output.c_str(), std::ios::binary);
+    std::ostringstream serial_text, parallel_text;
+    serial_text << serial_file.rdbuf();
+    parallel_text << parallel_file.rdbuf();
+    check(serial_text.str() == parallel_text.str(), name + ": the outputs of 1 and 4 workers are the same");
+
+    check(serial.good() && serial.animation_frames() == frames && serial.motion_channels() == channels,
+          name + ": the output loads: " + serial.error());
+    if (!serial.good() || serial.animation_frames() != frames)
+        return;
+
+    bool same_motion = true;
+    for (unsigned int frame = 0; frame < frames; frame++)
+        same_motion = same_motion && memcmp(serial.frame_values(frame), clip.frame_values(frame), channels * sizeof(float)) == 0;
+    check(same_motion, name + ": the output reloads as the same MOTION data");
+
+    check(serial.frame_time() == clip.frame_time(), name + ": the frame time reloads exactly");
+
+    const SKELETON & a = clip.getskeleton();
+    const SKELETON & b = serial.getskeleton();
+    bool same_hierarchy = a.num_joints == b.num_joints;
+
+    for (unsigned int joint = 0; joint < a.num_joints && same_hierarchy; joint++)
+        same_hierarchy = a.parent[joint] == b.parent[joint] && a.offset[joint] == b.offset[joint] &&
+                         a.num_channels[joint] == b.num_channels[joint] && strcmp(a.name[joint], b.name[joint]) == 0 &&
+                         std::equal(a.channels_order.begin() + a.channel_start[joint],
+                                    a.channels_order.begin() + a.channel_start[joint] + a.num_channels[joint],
+                                    b.channels_order.begin() + b.channel_start[joint]);
+    check(same_hierarchy, name + ": the hierarchy reloads the same");
+}
+
+int main()
+{
+    string directory = make_directory("test_write_bvh");
+    std::mt19937 random(24);
+
+    check_round_trip(directory, "longest", 10, 300, longest_values(2000));
+    check_round_trip(directory, "mixed", 7, 500, mixed_values(random));
+    check_round_trip(directory, "long", long_joints, long_frames, mixed_values(random));
+
+    // a header-only clip has no motion to write
+    LOAD_OPTIONS options;
+    options.use_cache = false;
+    options.header_only = true;
+
+    BVH header(string(directory + "/mixed.bvh").c_str(), options);
+    check(!header.write_bvh(string(directory + "/header.bvh").c_str()), "a header-only clip is not written");
+
+    remove_directory(directory);
+
+    std::cout << "test_write_bvh: " << (failures() ? "FAILED" : "passed") << "\n";
+    return failures() ? 1 : 0;
+}